@@ -0,0 +1,239 @@
+/* Benchmarks for the native add, mult and exp machines. Each one runs on
+ * growing inputs with no trace, with a text trace written to a file and with
+ * a text trace kept in memory, and the results are printed as JSON:
+ *
+ *   ./tmsim_bench [min seconds per case] > bench.json
+ *
+ * Runs that take less than the minimum time are repeated until they add up
+ * to it, and the numbers are per run. Then long untraced runs of mult and exp
+ * are timed on each engine, and last comes a comparison of the step counts of
+ * mult and exp with those of mult-fast and exp-fast.
+ */
+#define TMSIM_NO_MAIN
+#include "tmsim.cpp"
+
+#include <sys/resource.h>
+
+//one operation on one pair of inputs
+struct BenchCase {
+	const char *operation;
+	//the size of the inputs that grows from one case to the next
+	unsigned bits;
+	BigNum x, y;
+};
+
+//what running a case with one kind of trace came to
+struct BenchResult {
+	unsigned runs;
+	double seconds;
+	unsigned long long steps;
+	unsigned long long trace_bytes;
+	//-1 if the peak couldn't be reset before the case, so only the peak of the whole process is known
+	long peak_rss_kb;
+};
+
+//2^bits - 1, the largest number with that many bits
+BigNum allOnes(unsigned bits) {
+	BigNum res;
+	BigNum::parse("0b" + string(bits, '1'), res);
+	return res;
+}
+
+BigNum number(unsigned long long n) {
+	BigNum res;
+	BigNum::parse(to_string(n), res);
+	return res;
+}
+
+//start measuring the peak resident set size afresh; false where it can't be reset (Linux only, through clear_refs)
+bool resetPeakRss() {
+	ofstream clear("/proc/self/clear_refs");
+	clear << "5";
+	clear.close();
+	return !!clear;
+}
+
+//the peak resident set size in kB since resetPeakRss() last succeeded, or of the whole process if it never did
+long peakRss() {
+	long kb = -1;
+	ifstream status("/proc/self/status");
+	string line;
+	while (getline(status, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0)
+			kb = atol(line.c_str() + 6);
+	}
+	if (kb < 0) {
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		kb = usage.ru_maxrss;
+	}
+	return kb;
+}
+
+//run a case over and over with trace (one of "off", "file" or "memory") until min_seconds have gone by
+BenchResult runCase(const BenchCase &c, const string &trace, double min_seconds) {
+	BenchResult r = {0, 0, 0, 0, 0};
+	const string filename = "tmsim_bench_trace.tmp";
+	bool reset = resetPeakRss();
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	do {
+		SimContext ctx;
+		if (trace == "file") {
+			FileTraceSink sink(filename);
+			TextTracer tracer(sink);
+			runOperation<OriginTape>(c.operation, c.x, c.y, tracer, ctx);
+			sink.close();
+			r.trace_bytes += sink.offset();
+		}
+		else if (trace == "memory") {
+			string str;
+			StringTraceSink sink(str);
+			TextTracer tracer(sink);
+			runOperation<OriginTape>(c.operation, c.x, c.y, tracer, ctx);
+			r.trace_bytes += str.size();
+		}
+		else {
+			NullTracer tracer;
+			runOperation<OriginTape>(c.operation, c.x, c.y, tracer, ctx);
+		}
+		r.steps += ctx.steps;
+		r.runs++;
+		r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	} while (r.seconds < min_seconds);
+	r.peak_rss_kb = reset ? peakRss() : -1;
+	remove(filename.c_str());
+	return r;
+}
+
+//run a case with no trace on engine ("native", "table", "fixed" or "jit") until min_seconds have gone by
+BenchResult runEngine(const BenchCase &c, const Machine &m, const string &engine, double min_seconds) {
+	BenchResult r = {0, 0, 0, 0, 0};
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	do {
+		SimContext ctx;
+		NullTracer tracer;
+		if (engine == "native")
+			runOperation<OriginTape>(c.operation, c.x, c.y, tracer, ctx);
+		else if (engine == "table")
+			runMachine(m, c.x, c.y, tracer, ctx);
+		else if (engine == "jit")
+			runJit(m, c.x, c.y, tracer, ctx, false);
+		else if (c.operation == string("-mult"))
+			runFixed<FixedMult>(m, c.x, c.y, tracer, ctx);
+		else
+			runFixed<FixedExp>(m, c.x, c.y, tracer, ctx);
+		r.steps += ctx.steps;
+		r.runs++;
+		r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	} while (r.seconds < min_seconds);
+	return r;
+}
+
+/* the steps operation takes on x and y. mult and exp are worked out from their tapes (as with -count), so they can be
+ * compared with mult-fast and exp-fast on inputs they would take far too long to run on
+ */
+unsigned long long countSteps(const char *operation, const BigNum &x, const BigNum &y) {
+	SimContext ctx;
+	ctx.analytic = true;
+	NullTracer tracer;
+	runOperation<OriginTape>(operation, x, y, tracer, ctx);
+	return ctx.steps;
+}
+
+string jsonNumber(double v) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.6g", v);
+	return buf;
+}
+
+int main(int argc, char *argv[])
+{
+	double min_seconds = argc > 1 ? atof(argv[1]) : 0.5;
+	vector<BenchCase> cases;
+	//add takes a step for each unit of x, so its inputs only grow a few bits at a time
+	for (unsigned bits = 4; bits <= 16; bits += 4) {
+		BenchCase c = {"-add", bits, allOnes(bits), allOnes(bits)};
+		cases.push_back(c);
+	}
+	for (unsigned bits = 4; bits <= 12; bits += 4) {
+		BenchCase c = {"-mult", bits, allOnes(bits), allOnes(bits)};
+		cases.push_back(c);
+	}
+	//for exp it is the result that grows, by a bit for each unit of y
+	for (unsigned bits = 4; bits <= 20; bits += 4) {
+		BenchCase c = {"-exp", bits, number(2), number(bits)};
+		cases.push_back(c);
+	}
+	const char *traces[] = {"off", "file", "memory"};
+
+	std::cout << "{\n\t\"min_seconds\": " + jsonNumber(min_seconds) + ",\n\t\"benchmarks\": [";
+	for (size_t i = 0; i < cases.size(); i++) {
+		for (int t = 0; t < 3; t++) {
+			const BenchCase &c = cases[i];
+			BenchResult r = runCase(c, traces[t], min_seconds);
+			double per_run = r.seconds / r.runs;
+			std::cout << string(i + t > 0 ? "," : "") + "\n\t\t{\"operation\": \"" + (c.operation + 1)
+				+ "\", \"bits\": " + to_string(c.bits) + ", \"x\": \"" + c.x.toString() + "\", \"y\": \"" + c.y.toString()
+				+ "\", \"trace\": \"" + traces[t] + "\", \"runs\": " + to_string(r.runs)
+				+ ", \"steps\": " + to_string(r.steps / r.runs) + ", \"seconds\": " + jsonNumber(per_run)
+				+ ", \"steps_per_sec\": " + jsonNumber(r.steps / r.seconds) + ", \"ns_per_step\": " + jsonNumber(1e9 * r.seconds / r.steps)
+				+ ", \"trace_bytes\": " + to_string(r.trace_bytes / r.runs) + ", \"trace_bytes_per_sec\": " + jsonNumber(r.trace_bytes / r.seconds)
+				+ ", \"peak_rss_kb\": " + (r.peak_rss_kb < 0 ? "null" : to_string(r.peak_rss_kb)) + "}";
+			std::cout.flush();
+		}
+	}
+	std::cout << "\n\t],\n\t\"engines\": [";
+
+	//long runs with no trace, where each engine's cost per step is all there is to the time
+	vector<BenchCase> long_runs;
+	for (unsigned bits = 8; bits <= 12; bits += 4) {
+		BenchCase c = {"-mult", bits, allOnes(bits), allOnes(bits)};
+		long_runs.push_back(c);
+	}
+	for (unsigned bits = 16; bits <= 20; bits += 4) {
+		BenchCase c = {"-exp", bits, number(2), number(bits)};
+		long_runs.push_back(c);
+	}
+	MachineLibrary machines;
+	loadMachines(machines, "");
+	const char *engines[] = {"native", "table", "fixed", "jit"};
+	for (size_t i = 0; i < long_runs.size(); i++) {
+		const BenchCase &c = long_runs[i];
+		Machine m = machines.build(c.operation + 1);
+		double table_ns = 0;
+		for (int e = 0; e < 4; e++) {
+			BenchResult r = runEngine(c, m, engines[e], min_seconds);
+			double ns = 1e9 * r.seconds / r.steps;
+			if (engines[e] == string("table"))
+				table_ns = ns;
+			std::cout << string(i + e > 0 ? "," : "") + "\n\t\t{\"operation\": \"" + (c.operation + 1) + "\", \"bits\": "
+				+ to_string(c.bits) + ", \"x\": \"" + c.x.toString() + "\", \"y\": \"" + c.y.toString() + "\", \"engine\": \""
+				+ engines[e] + "\", \"runs\": " + to_string(r.runs) + ", \"steps\": " + to_string(r.steps / r.runs)
+				+ ", \"seconds\": " + jsonNumber(r.seconds / r.runs) + ", \"ns_per_step\": " + jsonNumber(ns)
+				+ (table_ns > 0 ? ", \"speedup_over_table\": " + jsonNumber(table_ns / ns) : string()) + "}";
+			std::cout.flush();
+		}
+	}
+	std::cout << "\n\t],\n\t\"comparison\": [";
+
+	//the steps of mult and exp next to those of mult-fast and exp-fast on the same inputs
+	vector<BenchCase> compared;
+	for (unsigned bits = 4; bits <= 28; bits += 4) {
+		BenchCase c = {"-mult", bits, allOnes(bits), allOnes(bits)};
+		compared.push_back(c);
+	}
+	for (unsigned bits = 4; bits <= 32; bits += 4) {
+		BenchCase c = {"-exp", bits, number(3), number(bits)};
+		compared.push_back(c);
+	}
+	for (size_t i = 0; i < compared.size(); i++) {
+		const BenchCase &c = compared[i];
+		unsigned long long steps = countSteps(c.operation, c.x, c.y);
+		unsigned long long fast_steps = countSteps(c.operation == string("-mult") ? "-mult-fast" : "-exp-fast", c.x, c.y);
+		std::cout << string(i > 0 ? "," : "") + "\n\t\t{\"operation\": \"" + (c.operation + 1) + "\", \"bits\": " + to_string(c.bits)
+			+ ", \"x\": \"" + c.x.toString() + "\", \"y\": \"" + c.y.toString() + "\", \"steps\": " + to_string(steps)
+			+ ", \"fast_steps\": " + to_string(fast_steps) + ", \"ratio\": " + jsonNumber((double)steps / fast_steps) + "}";
+	}
+	std::cout << "\n\t]\n}\n";
+	return 0;
+}
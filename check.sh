@@ -0,0 +1,247 @@
+#!/bin/bash
+# Runs tmsim on a small grid of inputs and checks that every way of running a
+# machine gives the same trace, index, result and step count as the native
+# simulation, and that the commands reading traces back work on them.
+# Usage: ./check.sh [tmsim binary]   ("make check" builds tmsim and runs it)
+
+tmsim=$(cd "$(dirname "${1:-./tmsim}")" && pwd)/$(basename "${1:-./tmsim}")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+checks=0
+failed=0
+
+ok() {
+	checks=$((checks + 1))
+}
+
+fail() {
+	checks=$((checks + 1))
+	failed=$((failed + 1))
+	echo "FAIL: $*"
+}
+
+# run tmsim with the given options in directory $1, keeping what it prints in $1/stdout
+run() {
+	local dir=$1
+	shift
+	mkdir -p "$work/$dir"
+	(cd "$work/$dir" && "$tmsim" "$@" > stdout 2>&1)
+}
+
+# the Result and Steps lines a run printed
+outcome() {
+	grep -E '^(Result|Steps):' "$work/$1/stdout"
+}
+
+# whether directories $1 and $2 hold the same trace and index for the run named $3
+same_trace() {
+	cmp -s "$work/$1/$3" "$work/$2/$3" && cmp -s "$work/$1/$3.idx" "$work/$2/$3.idx"
+}
+
+cases="add 0 0
+add 0 5
+add 5 0
+add 5 7
+add 13 29
+add 255 1
+add 1000 1000
+mult 0 7
+mult 7 0
+mult 1 1
+mult 3 5
+mult 31 33
+mult 300 500
+exp 0 3
+exp 3 0
+exp 1 5
+exp 2 3
+exp 3 4
+exp 2 10"
+
+while read op x y; do
+	name=${op}_${x}_${y}
+	ref=$name/native
+	if ! run $ref -$op $x $y; then
+		fail "$name: native run: $(cat "$work/$ref/stdout")"
+		continue
+	fi
+
+	# engines, tapes and the cache of the adds and mults inside mult and exp should change nothing but the time taken
+	variants="engine=table engine=fixed engine=jit packed mapped no-accel"
+	[ $op = add ] || variants="$variants cache=1"
+	for variant in $variants; do
+		dir=$name/$variant
+		if run $dir -$variant -$op $x $y && same_trace $ref $dir $name && [ "$(outcome $ref)" = "$(outcome $dir)" ]; then
+			ok
+		else
+			fail "$name: -$variant doesn't match the native run"
+		fi
+	done
+
+	# a delta trace expands back into the text trace
+	dir=$name/delta
+	if run $dir -trace-format=delta -$op $x $y && (cd "$work/$dir" && "$tmsim" -decode $name.tmd > /dev/null) \
+			&& cmp -s "$work/$ref/$name" "$work/$dir/$name"; then
+		ok
+	else
+		fail "$name: -decode of the delta trace doesn't give the text trace"
+	fi
+
+	# parallel tracing joins the same trace and index
+	dir=$name/parallel
+	if run $dir -workers=2 -parallel-trace=200 -$op $x $y && same_trace $ref $dir $name; then
+		ok
+	else
+		fail "$name: -parallel-trace doesn't match the native run"
+	fi
+
+	# working out the steps from the numbers on the tapes
+	dir=$name/count
+	if run $dir -count -$op $x $y && [ "$(outcome $ref)" = "$(outcome $dir)" ] && run $name/count-check -count=check -$op $x $y; then
+		ok
+	else
+		fail "$name: -count doesn't match the native run"
+	fi
+
+	# the start of the run can be found from the index
+	for dir in $ref $name/engine=table; do
+		if (cd "$work/$dir" && "$tmsim" -replay $name 0 | grep -q '^From step 0:' \
+				&& "$tmsim" -replay-tape $name 0 | grep -q '^After 0 steps:') 2> /dev/null; then
+			ok
+		else
+			fail "$name: -replay or -replay-tape can't find step 0 in the trace in $dir"
+		fi
+	done
+done <<< "$cases"
+
+# mult-fast and exp-fast come to the same results as mult and exp
+while read op x y; do
+	run fast/${op}_${x}_${y} -no-trace -$op $x $y
+	run fast/${op}-fast_${x}_${y} -no-trace -$op-fast $x $y
+	result=$(grep '^Result:' "$work/fast/${op}_${x}_${y}/stdout")
+	if [ -n "$result" ] && [ "$result" = "$(grep '^Result:' "$work/fast/${op}-fast_${x}_${y}/stdout")" ]; then
+		ok
+	else
+		fail "$op-fast $x $y doesn't give the result of $op"
+	fi
+done <<< "mult 0 5
+mult 5 0
+mult 6 7
+mult 31 33
+mult 255 255
+exp 0 0
+exp 3 4
+exp 2 10
+exp 5 3"
+
+# a batch of mixed machines gives each job the result, steps and trace of a run of its own
+mkdir -p "$work/batch"
+cat > "$work/batch/jobs.txt" <<- EOF
+	# machine x y
+	add 13 29
+	mult 31 33
+
+	-exp 2 3
+	add 0 5
+	exp 3 0
+	mult 300 500
+	EOF
+if ! run batch -batch jobs.txt -workers=3 || [ $(wc -l < "$work/batch/jobs.csv") -ne 7 ]; then
+	fail "-batch didn't run every job: $(cat "$work/batch/stdout")"
+else
+	ok
+fi
+while IFS=, read machine x y result steps rest; do
+	name=${machine}_${x}_${y}
+	if [ "$(printf 'Result: %s\nSteps: %s' "$result" "$steps")" = "$(outcome $name/native)" ] && same_trace $name/native batch $name; then
+		ok
+	else
+		fail "$name: the -batch job doesn't match the native run"
+	fi
+done < <(tail -n +2 "$work/batch/jobs.csv")
+
+# the trace modes give the same trace however the native machines are run, and the same result and steps as a
+# full trace; the engines only take the modes that don't depend on the native states
+for mode in trace-every=7 trace-window=3 trace-transitions trace-nested; do
+	for name in add_13_29 mult_3_5 exp_2_3; do
+		read op x y <<< "${name//_/ }"
+		ref=$name/$mode
+		if ! run $ref -$mode -$op $x $y || [ "$(outcome $name/native)" != "$(outcome $ref)" ]; then
+			fail "$name: -$mode doesn't give the result and steps of the full trace"
+			continue
+		fi
+		ok
+		variants="packed mapped no-accel"
+		case $mode in
+		trace-every=* | trace-window=*)
+			variants="engine=table engine=fixed engine=jit $variants"
+			;;
+		*)
+			if run $ref-table -engine=table -$mode -$op $x $y; then
+				fail "$name: -engine=table takes -$mode"
+			else
+				ok
+			fi
+			;;
+		esac
+		for variant in $variants "workers=2 -parallel-trace=100"; do
+			dir="$ref-${variant%% *}"
+			if run "$dir" -$variant -$mode -$op $x $y && same_trace $ref "$dir" $name; then
+				ok
+			else
+				fail "$name: -$variant -$mode doesn't match the native run"
+			fi
+		done
+
+		# a delta trace expands back into the same trace, with the window taken by -decode
+		dir=$ref-delta
+		if [ "$mode" = trace-window=3 ]; then
+			run $dir -trace-format=delta -$op $x $y && (cd "$work/$dir" && "$tmsim" -decode $name.tmd $name -$mode > /dev/null)
+		else
+			run $dir -trace-format=delta -$mode -$op $x $y && (cd "$work/$dir" && "$tmsim" -decode $name.tmd > /dev/null)
+		fi
+		if [ $? -eq 0 ] && cmp -s "$work/$ref/$name" "$work/$dir/$name"; then
+			ok
+		else
+			fail "$name: -decode of a delta trace with -$mode doesn't give the text trace"
+		fi
+	done
+done
+
+# the tape after a step of add, rebuilt from a trace that leaves steps out, is the one the full trace has
+run add-every -trace-every=7 -add 13 29
+for step in 1 6 50 100 202 203; do
+	full=$(cd "$work/add_13_29/native" && "$tmsim" -replay-tape add_13_29 $step)
+	sampled=$(cd "$work/add-every" && "$tmsim" -replay-tape add_13_29 $step)
+	if [ -n "$full" ] && [ "$(tail -n +2 <<< "$full")" = "$(tail -n +2 <<< "$sampled")" ]; then
+		ok
+	else
+		fail "add 13 29: -replay-tape $step of a -trace-every=7 trace differs from the full trace"
+	fi
+done
+
+# -count gives up at once on inputs whose step count can't fit in 64 bits, rather than simulating them
+for args in "-add 18446744073709551616 1" "-mult 4294967296 4294967296" "-mult 1 18446744073709551616"; do
+	if (cd "$work" && timeout 10 "$tmsim" -count $args 2>&1 | grep -q 'goes past 2^64'); then
+		ok
+	else
+		fail "-count $args doesn't report the step count going past 2^64"
+	fi
+done
+
+# a run stopped after a checkpoint and resumed writes the same trace as one that wasn't
+name=mult_1000_65535
+run resume-ref -mult 1000 65535
+mkdir -p "$work/resume"
+(cd "$work/resume" && timeout -s KILL 0.5 "$tmsim" -checkpoint-every=0.05 -mult 1000 65535 > /dev/null) 2> /dev/null
+if [ ! -f "$work/resume/$name.ckpt" ]; then
+	fail "mult 1000 65535: no checkpoint was left to resume from"
+elif (cd "$work/resume" && "$tmsim" -resume $name.ckpt > stdout 2>&1) && same_trace resume-ref resume $name \
+		&& [ "$(outcome resume-ref)" = "$(outcome resume)" ]; then
+	ok
+else
+	fail "mult 1000 65535: the resumed run doesn't match an uninterrupted one"
+fi
+
+echo "$checks checks, $failed failed"
+[ $failed -eq 0 ]
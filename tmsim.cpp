@@ -3,556 +3,7242 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <sstream>
+#include <memory>
+#include <cstring>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <chrono>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 using namespace std;
 
-/* make an int into a vector of chars representing its reverse binary 
+//make sure what has been written to a file or directory is on the disk, not just in the system's cache
+bool syncFile(const string &path) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	bool ok = fsync(fd) == 0;
+	::close(fd);
+	return ok;
+}
+
+//destination for trace text as a simulation produces it
+class TraceSink {
+public:
+	virtual ~TraceSink() {}
+	virtual void write(const char *data, size_t len) = 0;
+	//make sure everything written so far has reached its destination
+	virtual void close() {}
+	TraceSink &operator+=(const string &text) {
+		write(text.data(), text.size());
+		return *this;
+	}
+};
+
+//keeps the whole trace in a string in memory
+class StringTraceSink : public TraceSink {
+public:
+	explicit StringTraceSink(string &str) : str(str) {}
+	void write(const char *data, size_t len) {
+		str.append(data, len);
+	}
+private:
+	string &str;
+};
+
+/* collects trace text in fixed size buffers and hands each full buffer to a
+ * background thread that writes it to a file, so memory use stays bounded by
+ * max_pending buffers no matter how long the trace gets, and the simulation
+ * only waits on the disk when the writer falls that far behind. A write that
+ * fails on the writer thread is remembered, and flush() and close() throw a
+ * runtime_error for it.
+ */
+class FileTraceSink : public TraceSink {
+public:
+	explicit FileTraceSink(const string &filename, size_t buf_size = 1 << 20, size_t max_pending = 4)
+		: filename(filename), out(filename.c_str(), ios::binary), buf_size(buf_size), max_pending(max_pending), done(false),
+		written(0), busy(false), failed(false) {
+		start();
+	}
+	/* carry on a trace file that an earlier run had written up to offset. Anything it wrote past there is simply
+	 * overwritten, since a run that picks up from the same point writes the same bytes again.
+	 */
+	FileTraceSink(const string &filename, unsigned long long offset)
+		: filename(filename), out(filename.c_str(), ios::binary | ios::in | ios::out), buf_size(1 << 20), max_pending(4),
+		done(false), written(offset), busy(false), failed(false) {
+		out.seekp(offset);
+		start();
+	}
+	~FileTraceSink() {
+		finish();
+	}
+	bool isOpen() const {
+		return out.is_open();
+	}
+	void write(const char *data, size_t len) {
+		written += len;
+		while (len > 0) {
+			size_t n = min(len, buf_size - cur.size());
+			cur.append(data, n);
+			data += n;
+			len -= n;
+			if (cur.size() == buf_size)
+				flushBuffer();
+		}
+	}
+	void close() {
+		if (!writer.joinable())
+			return;
+		finish();
+		check();
+	}
+	//wait until everything written so far has been handed to the file
+	void flush() {
+		if (!cur.empty())
+			flushBuffer();
+		unique_lock<mutex> lock(mtx);
+		while (!pending.empty() || busy)
+			has_room.wait(lock);
+		out.flush();
+		failed = failed || !out;
+		lock.unlock();
+		check();
+	}
+	//flush, and wait until the disk has it too
+	void sync() {
+		flush();
+		if (!syncFile(filename))
+			throw runtime_error("Could not write trace file '" + filename + "'");
+	}
+	//bytes in the file once everything written so far gets there
+	unsigned long long offset() const {
+		return written;
+	}
+private:
+	void start() {
+		cur.reserve(buf_size);
+		writer = thread(&FileTraceSink::writerLoop, this);
+	}
+
+	//write out what is left and stop the writer thread, without throwing so that the destructor can use it
+	void finish() {
+		if (!writer.joinable())
+			return;
+		if (!cur.empty())
+			flushBuffer();
+		{
+			lock_guard<mutex> lock(mtx);
+			done = true;
+		}
+		has_work.notify_one();
+		writer.join();
+		out.close();
+		failed = failed || !out;
+	}
+
+	void check() const {
+		if (failed)
+			throw runtime_error("Could not write trace file \'" + filename + "\'");
+	}
+
+	//queue the current buffer for the writer thread, waiting if too many are already queued
+	void flushBuffer() {
+		unique_lock<mutex> lock(mtx);
+		while (pending.size() >= max_pending)
+			has_room.wait(lock);
+		pending.push_back(string());
+		pending.back().swap(cur);
+		if (!spare.empty()) {
+			cur.swap(spare.back());
+			spare.pop_back();
+		}
+		else
+			cur.reserve(buf_size);
+		lock.unlock();
+		has_work.notify_one();
+	}
+
+	void writerLoop() {
+		string buf;
+		unique_lock<mutex> lock(mtx);
+		while (1) {
+			while (pending.empty() && !done)
+				has_work.wait(lock);
+			if (pending.empty())
+				return;
+			buf.swap(pending.front());
+			pending.pop_front();
+			busy = true;
+			lock.unlock();
+			out.write(buf.data(), buf.size());
+			bool ok = !!out;
+			buf.clear();
+			lock.lock();
+			failed = failed || !ok;
+			busy = false;
+			//hand the emptied buffer back so the simulation doesn't need to allocate a new one
+			spare.push_back(string());
+			spare.back().swap(buf);
+			has_room.notify_one();
+		}
+	}
+
+	string filename;
+	ofstream out;
+	size_t buf_size;
+	size_t max_pending;
+	string cur;
+	deque<string> pending;
+	vector<string> spare;
+	mutex mtx;
+	condition_variable has_work;
+	condition_variable has_room;
+	bool done;
+	unsigned long long written;
+	//whether the writer thread is in the middle of writing a buffer
+	bool busy;
+	//whether a write to the file has failed
+	bool failed;
+	thread writer;
+};
+
+/* read-only view of the cells of a tape, so tracers can look at a tape without
+ * copying it. A view can also be a window of the tape (see WindowTracer), in
+ * which case cells starts at cell first of a tape of whole cells.
+ */
+struct TapeView {
+	const char *cells;
+	size_t len;
+	size_t first;
+	size_t whole;
+	TapeView() : cells(nullptr), len(0), first(0), whole(0) {}
+	TapeView(const char *cells, size_t len) : cells(cells), len(len), first(0), whole(len) {}
+	TapeView(const char *cells, size_t len, size_t first, size_t whole) : cells(cells), len(len), first(first), whole(whole) {}
+	//whether some of the tape is left out
+	bool windowed() const {
+		return len != whole;
+	}
+};
+
+//the index of a cell, 64 bits wide so a tape can grow past 2^31 cells
+typedef long long TapeIdx;
+
+TapeView view(const vector<char> &tape) {
+	TapeView v = {tape.data(), tape.size()};
+	return v;
+}
+
+//one tape (and the position of its head) in a traced configuration of a multi-tape TM
+struct TracedTape {
+	const char *name;
+	TapeIdx idx;
+	TapeView tape;
+};
+
+class DeltaReader;
+
+/* receives the records of a simulation's trace and decides how they are
+ * represented (readable text, delta encoded binary) before they go to a sink.
+ * State and tape names have to stay where they are, unchanged, for the whole
+ * trace, as string literals and the names of a Machine do.
+ */
+class Tracer {
+public:
+	virtual ~Tracer() {}
+	//free-form text such as the header and the interpreted result
+	virtual void text(const string &str) = 0;
+	/* the state a TM traced with step() starts in, before its first step.
+	 * Its tape is the one the first step() shows, so it is written as text,
+	 * but it is a record of step 0 all the same.
+	 */
+	virtual void start(const char *state, TapeIdx idx) {
+		text(string("State: ") + state + "\nCurrent index: " + to_string(idx) + "\n");
+	}
+	/* one step of a TM that is traced at every step, recorded before the step
+	 * is taken. Only the cell under the head of the previous step and cells
+	 * past the previous end of the tape can differ from the last record.
+	 */
+	virtual void step(const char *state, TapeIdx idx, TapeView tape) = 0;
+	//the halt of a TM that was traced with step()
+	virtual void halt(TapeIdx idx, TapeView tape) = 0;
+	/* the configuration of a multi-tape TM at a critical step. The initial
+	 * configuration shows its tapes as "Initial" instead of "Current".
+	 */
+	virtual void config(const char *state, const TracedTape *tapes, int count, bool initial) = 0;
+	//append what the tracer has to remember about the records so far to carry on from here, for a checkpoint
+	virtual void saveState(string &) const {}
+	//carry on from the state saveState() saved
+	virtual void loadState(DeltaReader &) {}
+};
+
+//append n in decimal to out, without making a string of it first
+void appendDecimal(string &out, long long n) {
+	char digits[24];
+	char *end = digits + sizeof(digits);
+	char *p = end;
+	unsigned long long v = n < 0 ? 0ULL - (unsigned long long)n : (unsigned long long)n;
+	do {
+		*--p = (char)('0' + v % 10);
+		v /= 10;
+	} while (v);
+	if (n < 0)
+		*--p = '-';
+	out.append(p, end - p);
+}
+
+/* the readable trace format. Each record is put together in rec, which keeps
+ * its memory from one record to the next, so tracing a step doesn't allocate.
+ */
+class TextTracer : public Tracer {
+public:
+	explicit TextTracer(TraceSink &sink) : sink(sink) {}
+	void text(const string &str) {
+		sink += str;
+	}
+	void step(const char *state, TapeIdx idx, TapeView tape) {
+		putCells(tape);
+		rec.assign("\n\nState: ");
+		rec += state;
+		rec += "\nCurrent index: ";
+		appendDecimal(rec, idx);
+		rec += '\n';
+		if (tape.windowed()) {
+			rec += "Cells shown: ";
+			appendRange(tape);
+			rec += '\n';
+		}
+		flush();
+	}
+	void halt(TapeIdx idx, TapeView tape) {
+		step("Halt", idx, tape);
+		putCells(tape);
+	}
+	void config(const char *state, const TracedTape *tapes, int count, bool initial) {
+		rec.assign("State: ");
+		rec += state;
+		rec += '\n';
+		for (int i = 0; i < count; i++) {
+			rec += "Current ";
+			rec += tapes[i].name;
+			rec += " Index: ";
+			appendDecimal(rec, tapes[i].idx);
+			rec += '\n';
+		}
+		for (int i = 0; i < count; i++) {
+			rec += initial ? "Initial " : "Current ";
+			rec += tapes[i].name;
+			rec += " Tape";
+			if (tapes[i].tape.windowed()) {
+				rec += " (cells ";
+				appendRange(tapes[i].tape);
+				rec += ')';
+			}
+			rec += ": ";
+			flush();
+			putCells(tapes[i].tape);
+			rec += '\n';
+		}
+		rec += '\n';
+		flush();
+	}
+
+	//how many bytes the cells of a view take up in the trace, which is where the record of a step starts
+	static size_t cellsLength(TapeView tape) {
+		return tape.len + (tape.first > 0 ? 3 : 0) + (tape.first + tape.len < tape.whole ? 3 : 0);
+	}
+private:
+	void flush() {
+		sink.write(rec.data(), rec.size());
+		rec.clear();
+	}
+
+	//the cells of a view, with "..." where a window leaves out the rest of the tape
+	void putCells(TapeView tape) {
+		if (tape.first > 0)
+			sink.write("...", 3);
+		sink.write(tape.cells, tape.len);
+		if (tape.first + tape.len < tape.whole)
+			sink.write("...", 3);
+	}
+
+	//the indices of the first and last cells of a window
+	void appendRange(TapeView tape) {
+		appendDecimal(rec, tape.first);
+		rec += '-';
+		appendDecimal(rec, (long long)(tape.first + tape.len) - 1);
+	}
+
+	TraceSink &sink;
+	string rec;
+};
+
+//drops every record, for runs where only the result and step count are wanted
+class NullTracer : public Tracer {
+public:
+	void text(const string &) {}
+	void step(const char *, TapeIdx, TapeView) {}
+	void halt(TapeIdx, TapeView) {}
+	void config(const char *, const TracedTape *, int, bool) {}
+};
+
+/* Compact binary trace format. Instead of whole tapes, each record stores the
+ * state, how far each head moved and the cells that changed since the previous
+ * record, with a full copy of every tape (a keyframe) once every keyframe_every
+ * records so that no record depends on more than that many before it.
+ *
+ *   file:    "TMSD" version keyframe_every record...
+ *   TEXT:    tag len bytes
+ *   STEP:    tag state head_move tape
+ *   HALT:    tag head_move tape
+ *   CONFIG:  tag state initial count (name head_move tape)...
+ *   tape:    KEYFRAME len cells | CHANGES len runs (gap run_len cells)...
+ *   step tape: KEYFRAME len cells | STEP_CELLS+flags [head_cell] [grown_by cells]
+ *              | CHANGES len runs... (when steps were left out of the trace)
+ *
+ * All numbers are varints and head moves are zigzag encoded. States and tape
+ * names are indices into a table built up as the trace goes; an index equal to
+ * the size of the table is followed by len bytes of a new name.
+ */
+enum DeltaTag {
+	DELTA_TEXT = 1,
+	DELTA_STEP,
+	DELTA_HALT,
+	DELTA_CONFIG
+};
+
+enum DeltaTapeKind {
+	DELTA_KEYFRAME,
+	DELTA_CHANGES,
+	//only used by STEP and HALT, combined with the flags below
+	DELTA_STEP_CELLS = 4,
+	DELTA_HEAD_CELL = 8,
+	DELTA_GROWN = 16
+};
+
+const char DELTA_MAGIC[] = "TMSD";
+const unsigned char DELTA_VERSION = 1;
+
+void putVarint(string &out, unsigned long long v) {
+	while (v >= 0x80) {
+		out.push_back((char)(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((char)v);
+}
+
+unsigned long long zigzag(long long v) {
+	return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+long long unzigzag(unsigned long long v) {
+	return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+//reads the bytes, varints and strings that make up a delta trace, or another file in the same encoding
+class DeltaReader {
+public:
+	explicit DeltaReader(istream &in, const string &what = "delta trace") : buf(in.rdbuf()), what(what) {}
+	bool atEnd() {
+		return buf->sgetc() == char_traits<char>::eof();
+	}
+	unsigned char byte() {
+		int c = buf->sbumpc();
+		if (c == char_traits<char>::eof())
+			throw runtime_error(what + " ends in the middle of a record");
+		return (unsigned char)c;
+	}
+	unsigned long long varint() {
+		unsigned long long v = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			unsigned char c = byte();
+			v |= (unsigned long long)(c & 0x7f) << shift;
+			if (!(c & 0x80))
+				return v;
+		}
+		throw runtime_error("bad varint in " + what);
+	}
+	void bytes(char *out, size_t len) {
+		if ((size_t)buf->sgetn(out, len) != len)
+			throw runtime_error(what + " ends in the middle of a record");
+	}
+private:
+	streambuf *buf;
+	string what;
+};
+
+//what the encoder and decoder know about one tape from the records so far
+struct DeltaShadow {
+	vector<char> cells;
+	TapeIdx idx;
+	unsigned since_keyframe;
+	DeltaShadow() : idx(0), since_keyframe(0) {}
+};
+
+class DeltaTracer : public Tracer {
+public:
+	/* resumed is set when carrying on a trace that already has its header, see loadState(). every_step is cleared
+	 * when some steps of a one-tape machine aren't traced, so a step can change any cell since the last one.
+	 */
+	DeltaTracer(TraceSink &sink, unsigned keyframe_every = 4096, bool resumed = false, bool every_step = true)
+		: sink(sink), keyframe_every(keyframe_every ? keyframe_every : 1), every_step(every_step), last_name(NULL), last_id(0) {
+		if (resumed)
+			return;
+		rec.assign(DELTA_MAGIC, 4);
+		rec.push_back((char)DELTA_VERSION);
+		putVarint(rec, this->keyframe_every);
+		flush();
+	}
+	void text(const string &str) {
+		rec.push_back((char)DELTA_TEXT);
+		putVarint(rec, str.size());
+		rec += str;
+		flush();
+	}
+	void step(const char *state, TapeIdx idx, TapeView tape) {
+		rec.push_back((char)DELTA_STEP);
+		putName(state);
+		putVarint(rec, zigzag(idx - step_tape.idx));
+		putStepTape(tape);
+		step_tape.idx = idx;
+		flush();
+	}
+	void halt(TapeIdx idx, TapeView tape) {
+		rec.push_back((char)DELTA_HALT);
+		putVarint(rec, zigzag(idx - step_tape.idx));
+		putStepTape(tape);
+		step_tape.idx = idx;
+		flush();
+	}
+	void config(const char *state, const TracedTape *tapes, int count, bool initial) {
+		rec.push_back((char)DELTA_CONFIG);
+		putName(state);
+		rec.push_back(initial ? 1 : 0);
+		putVarint(rec, count);
+		if ((int)config_tapes.size() < count)
+			config_tapes.resize(count);
+		for (int i = 0; i < count; i++) {
+			DeltaShadow &shadow = config_tapes[i];
+			putName(tapes[i].name);
+			putVarint(rec, zigzag(tapes[i].idx - shadow.idx));
+			putTape(shadow, tapes[i].tape);
+			shadow.idx = tapes[i].idx;
+		}
+		flush();
+	}
+	void saveState(string &out) const {
+		putVarint(out, names.size());
+		for (map<string, unsigned>::const_iterator it = names.begin(); it != names.end(); ++it) {
+			putVarint(out, it->second);
+			putVarint(out, it->first.size());
+			out += it->first;
+		}
+		saveShadow(out, step_tape);
+		putVarint(out, config_tapes.size());
+		for (size_t i = 0; i < config_tapes.size(); i++)
+			saveShadow(out, config_tapes[i]);
+	}
+	void loadState(DeltaReader &in) {
+		names.clear();
+		for (unsigned long long n = in.varint(); n > 0; n--) {
+			unsigned id = in.varint();
+			string name(in.varint(), '\0');
+			in.bytes(&name[0], name.size());
+			names[name] = id;
+		}
+		name_ids.clear();
+		last_name = NULL;
+		loadShadow(in, step_tape);
+		config_tapes.resize(in.varint());
+		for (size_t i = 0; i < config_tapes.size(); i++)
+			loadShadow(in, config_tapes[i]);
+	}
+private:
+	static void saveShadow(string &out, const DeltaShadow &shadow) {
+		putVarint(out, shadow.cells.size());
+		out.append(shadow.cells.data(), shadow.cells.size());
+		putVarint(out, zigzag(shadow.idx));
+		putVarint(out, shadow.since_keyframe);
+	}
+	static void loadShadow(DeltaReader &in, DeltaShadow &shadow) {
+		shadow.cells.resize(in.varint());
+		in.bytes(shadow.cells.data(), shadow.cells.size());
+		shadow.idx = unzigzag(in.varint());
+		shadow.since_keyframe = in.varint();
+	}
+
+	void flush() {
+		sink.write(rec.data(), rec.size());
+		rec.clear();
+	}
+
+	void putName(const char *name) {
+		//scanning states repeat the same name many times in a row
+		if (name == last_name) {
+			putVarint(rec, last_id);
+			return;
+		}
+		//configs switch names every record, so a name passed before is found by its pointer without making a string of it
+		unordered_map<const char *, unsigned>::iterator seen = name_ids.find(name);
+		if (seen != name_ids.end()) {
+			last_id = seen->second;
+			last_name = name;
+			putVarint(rec, last_id);
+			return;
+		}
+		map<string, unsigned>::iterator it = names.find(name);
+		if (it != names.end())
+			last_id = it->second;
+		else {
+			last_id = names.size();
+			names[name] = last_id;
+			name_ids[name] = last_id;
+			putVarint(rec, last_id);
+			putVarint(rec, strlen(name));
+			rec += name;
+			last_name = name;
+			return;
+		}
+		name_ids[name] = last_id;
+		last_name = name;
+		putVarint(rec, last_id);
+	}
+
+	//returns whether this record should hold a full copy of the tape
+	bool keyframeDue(DeltaShadow &shadow) {
+		if (shadow.since_keyframe++ % keyframe_every != 0)
+			return false;
+		rec.push_back((char)DELTA_KEYFRAME);
+		return true;
+	}
+
+	void putKeyframe(DeltaShadow &shadow, TapeView tape) {
+		putVarint(rec, tape.len);
+		rec.append(tape.cells, tape.len);
+		shadow.cells.assign(tape.cells, tape.cells + tape.len);
+	}
+
+	//encode cells [start, end) of the tape as a run, gap cells after the previous run
+	void putRun(size_t gap, const char *cells, size_t start, size_t end) {
+		putVarint(rec, gap);
+		putVarint(rec, end - start);
+		rec.append(cells + start, end - start);
+	}
+
+	/* a per-step record can only have changed the cell the head was on in the
+	 * previous record, plus any cells the tape grew by, so only those are checked
+	 * and the position of the changed cell doesn't need to be stored
+	 */
+	void putStepTape(TapeView tape) {
+		DeltaShadow &shadow = step_tape;
+		if (!every_step) {
+			putTape(shadow, tape);
+			return;
+		}
+		if (keyframeDue(shadow)) {
+			putKeyframe(shadow, tape);
+			return;
+		}
+		size_t old_len = shadow.cells.size();
+		size_t prev = shadow.idx;
+		bool changed = shadow.idx >= 0 && prev < old_len && prev < tape.len && shadow.cells[prev] != tape.cells[prev];
+		bool grown = tape.len > old_len;
+		rec.push_back((char)(DELTA_STEP_CELLS | (changed ? DELTA_HEAD_CELL : 0) | (grown ? DELTA_GROWN : 0)));
+		if (changed) {
+			rec.push_back(tape.cells[prev]);
+			shadow.cells[prev] = tape.cells[prev];
+		}
+		if (grown) {
+			putVarint(rec, tape.len - old_len);
+			rec.append(tape.cells + old_len, tape.len - old_len);
+			shadow.cells.insert(shadow.cells.end(), tape.cells + old_len, tape.cells + tape.len);
+		}
+	}
+
+	//compare the whole tape with what the decoder will have and encode the runs that differ
+	void putTape(DeltaShadow &shadow, TapeView tape) {
+		if (keyframeDue(shadow)) {
+			putKeyframe(shadow, tape);
+			return;
+		}
+		rec.push_back((char)DELTA_CHANGES);
+		putVarint(rec, tape.len);
+		runs.clear();
+		const char *old = shadow.cells.data();
+		size_t common = min(shadow.cells.size(), tape.len);
+		size_t i = 0;
+		while (i < common) {
+			//skip over matching blocks quickly
+			if (common - i >= 64 && memcmp(old + i, tape.cells + i, 64) == 0) {
+				i += 64;
+				continue;
+			}
+			if (old[i] == tape.cells[i]) {
+				i++;
+				continue;
+			}
+			//a run continues until 8 cells in a row match, since a run costs a few bytes of overhead
+			size_t start = i, end = i + 1, same = 0;
+			for (i = end; i < common && same < 8; i++) {
+				if (old[i] == tape.cells[i])
+					same++;
+				else {
+					same = 0;
+					end = i + 1;
+				}
+			}
+			runs.push_back(start);
+			runs.push_back(end);
+			i = end;
+		}
+		if (tape.len > shadow.cells.size()) {
+			runs.push_back(shadow.cells.size());
+			runs.push_back(tape.len);
+		}
+		putVarint(rec, runs.size() / 2);
+		size_t last = 0;
+		for (size_t r = 0; r < runs.size(); r += 2) {
+			putRun(runs[r] - last, tape.cells, runs[r], runs[r + 1]);
+			last = runs[r + 1];
+		}
+		shadow.cells.assign(tape.cells, tape.cells + tape.len);
+	}
+
+	TraceSink &sink;
+	unsigned keyframe_every;
+	bool every_step;
+	string rec;
+	vector<size_t> runs;
+	map<string, unsigned> names;
+	//ids of the names by the pointers they were passed as
+	unordered_map<const char *, unsigned> name_ids;
+	const char *last_name;
+	unsigned last_id;
+	DeltaShadow step_tape;
+	vector<DeltaShadow> config_tapes;
+};
+
+/* shows only the cells within radius of each head (-trace-window), so a record
+ * costs the same however long the tapes of a run get
+ */
+class WindowTracer : public Tracer {
+public:
+	WindowTracer(Tracer &inner, size_t radius) : inner(inner), radius(radius) {}
+	void text(const string &str) {
+		inner.text(str);
+	}
+	void start(const char *state, TapeIdx idx) {
+		inner.start(state, idx);
+	}
+	void step(const char *state, TapeIdx idx, TapeView tape) {
+		inner.step(state, idx, window(tape, idx));
+	}
+	void halt(TapeIdx idx, TapeView tape) {
+		inner.halt(idx, window(tape, idx));
+	}
+	void config(const char *state, const TracedTape *tapes, int count, bool initial) {
+		windows.assign(tapes, tapes + count);
+		for (int i = 0; i < count; i++)
+			windows[i].tape = window(tapes[i].tape, tapes[i].idx);
+		inner.config(state, windows.data(), count, initial);
+	}
+	void saveState(string &out) const {
+		inner.saveState(out);
+	}
+	void loadState(DeltaReader &in) {
+		inner.loadState(in);
+	}
+private:
+	TapeView window(TapeView tape, TapeIdx idx) const {
+		size_t head = idx < 0 ? 0 : min((size_t)idx, tape.len);
+		size_t from = head > radius ? head - radius : 0;
+		size_t to = tape.len - head > radius ? head + radius + 1 : tape.len;
+		return TapeView(tape.cells + from, to - from, tape.first + from, tape.whole);
+	}
+
+	Tracer &inner;
+	size_t radius;
+	vector<TracedTape> windows;
+};
+
+/* passes on only every nth of the steps and configurations (-trace-every), but
+ * always the initial configuration, the halt and the text
+ */
+class SampleTracer : public Tracer {
+public:
+	SampleTracer(Tracer &inner, unsigned long long every) : inner(inner), every(every ? every : 1), seen(0) {}
+	void text(const string &str) {
+		inner.text(str);
+	}
+	void start(const char *state, TapeIdx idx) {
+		inner.start(state, idx);
+	}
+	void step(const char *state, TapeIdx idx, TapeView tape) {
+		if (seen++ % every == 0)
+			inner.step(state, idx, tape);
+	}
+	void halt(TapeIdx idx, TapeView tape) {
+		inner.halt(idx, tape);
+	}
+	void config(const char *state, const TracedTape *tapes, int count, bool initial) {
+		//multi-tape machines halt with a configuration of their own
+		if (initial || seen++ % every == 0 || strcmp(state, "Halt") == 0)
+			inner.config(state, tapes, count, initial);
+	}
+	void saveState(string &out) const {
+		putVarint(out, seen);
+		inner.saveState(out);
+	}
+	void loadState(DeltaReader &in) {
+		seen = in.varint();
+		inner.loadState(in);
+	}
+private:
+	Tracer &inner;
+	unsigned long long every;
+	//steps and configurations seen so far
+	unsigned long long seen;
+};
+
+//the name of a state inside a black box state, like Add*/TakeOneX, which stays put for as long as the program runs
+const char *nestedName(const char *box, const char *state) {
+	static mutex mtx;
+	static map<pair<string, string>, string> names;
+	lock_guard<mutex> lock(mtx);
+	string &name = names[make_pair(string(box), string(state))];
+	if (name.empty())
+		name = string(box) + "/" + state;
+	return name.c_str();
+}
+
+/* puts the trace of a machine run as a black box state of another (Add* in
+ * mult, Mult* in exp) into the trace of the outer machine, with -trace-nested.
+ * Its records become configurations of the outer machine, with the state
+ * named after the black box and the inner state and the outer machine's other
+ * tapes after those of the inner machine.
+ */
+class NestedTracer : public Tracer {
+public:
+	//tape_name names the tape of a machine that is traced a step at a time; others are the outer machine's tapes
+	NestedTracer(Tracer &outer, const char *box, const char *tape_name, const TracedTape *others, int count)
+		: outer(outer), box(box), tape_name(tape_name), others(others, others + count) {}
+	//the inner machine's header isn't wanted in the middle of the outer one's trace
+	void text(const string &) {}
+	void step(const char *state, TapeIdx idx, TapeView tape) {
+		TracedTape inner = {tape_name, idx, tape};
+		config(state, &inner, 1, false);
+	}
+	void halt(TapeIdx idx, TapeView tape) {
+		step("Halt", idx, tape);
+	}
+	void config(const char *state, const TracedTape *inner, int count, bool initial) {
+		tapes.assign(inner, inner + count);
+		tapes.insert(tapes.end(), others.begin(), others.end());
+		outer.config(name(state), tapes.data(), tapes.size(), initial);
+	}
+private:
+	const char *name(const char *state) {
+		const char *&res = names[state];
+		if (!res)
+			res = nestedName(box, state);
+		return res;
+	}
+
+	Tracer &outer;
+	const char *box;
+	const char *tape_name;
+	vector<TracedTape> others;
+	vector<TracedTape> tapes;
+	//nestedName of each state, so it is only looked up once per run
+	unordered_map<const char *, const char *> names;
+};
+
+//how much of a simulation goes in its trace, as set on the command line
+struct TraceDetail {
+	//cells shown on each side of a head (WindowTracer), or -1 for whole tapes
+	long long window;
+	//keep one in this many steps and configurations (SampleTracer)
+	unsigned long long every;
+	//whether add only traces the steps where it moves to another state
+	bool transitions;
+	//whether the add and mult runs of Add* and Mult* are traced
+	bool nested;
+	TraceDetail() : window(-1), every(1), transitions(false), nested(false) {}
+	//whether every step of a machine traced a step at a time is in the trace
+	bool everyStep() const {
+		return every == 1 && !transitions;
+	}
+};
+
+//put the tracers that leave out what detail asks for in front of trace, in owned, and return the one to use
+Tracer &detailTracer(Tracer &trace, const TraceDetail &detail, vector<unique_ptr<Tracer> > &owned) {
+	Tracer *res = &trace;
+	if (detail.window >= 0) {
+		owned.push_back(unique_ptr<Tracer>(new WindowTracer(*res, detail.window)));
+		res = owned.back().get();
+	}
+	if (detail.every > 1) {
+		owned.push_back(unique_ptr<Tracer>(new SampleTracer(*res, detail.every)));
+		res = owned.back().get();
+	}
+	return *res;
+}
+
+/* a non-negative integer of any size, for inputs and results that don't fit
+ * in an int. Stored as 32 bit limbs, least significant first, with no zero
+ * limbs at the top.
+ */
+class BigNum {
+public:
+	BigNum(unsigned long long v = 0) {
+		for (; v != 0; v >>= 32)
+			limbs.push_back((uint32_t)v);
+	}
+
+	//parse a decimal number, or a hex or binary one with a 0x or 0b prefix
+	static bool parse(const string &str, BigNum &res) {
+		res.limbs.clear();
+		unsigned base = 10;
+		size_t start = 0;
+		if (str.size() > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X' || str[1] == 'b' || str[1] == 'B')) {
+			base = (str[1] == 'x' || str[1] == 'X') ? 16 : 2;
+			start = 2;
+		}
+		if (start == str.size())
+			return false;
+		if (base != 10) {
+			//each digit is a whole number of bits, so fill the bits in from the last digit
+			unsigned bits_per_digit = base == 16 ? 4 : 1;
+			size_t bit = 0;
+			for (size_t i = str.size(); i-- > start; bit += bits_per_digit) {
+				int d = digitValue(str[i]);
+				if (d < 0 || d >= (int)base)
+					return false;
+				if (bit / 32 >= res.limbs.size())
+					res.limbs.push_back(0);
+				res.limbs[bit / 32] |= (uint32_t)d << (bit % 32);
+			}
+			res.trim();
+			return true;
+		}
+		//9 decimal digits at a time fit in a limb
+		for (size_t i = start; i < str.size(); ) {
+			uint32_t chunk = 0, mul = 1;
+			for (size_t end = min(str.size(), i + 9); i < end; i++) {
+				if (str[i] < '0' || str[i] > '9')
+					return false;
+				chunk = chunk * 10 + (str[i] - '0');
+				mul *= 10;
+			}
+			res.mulAdd(mul, chunk);
+		}
+		return true;
+	}
+
+	//read reverse binary cells (least significant first); cells other than '1' count as 0
+	static BigNum fromBits(const char *cells, size_t len) {
+		BigNum res;
+		res.limbs.assign((len + 31) / 32, 0);
+		for (size_t i = 0; i < len; i++)
+			if (cells[i] == '1')
+				res.limbs[i / 32] |= (uint32_t)1 << (i % 32);
+		res.trim();
+		return res;
+	}
+
+	size_t bitLength() const {
+		if (limbs.empty())
+			return 0;
+		return 32 * (limbs.size() - 1) + 32 - __builtin_clz(limbs.back());
+	}
+
+	bool bit(size_t i) const {
+		return i / 32 < limbs.size() && ((limbs[i / 32] >> (i % 32)) & 1);
+	}
+
+	/* decimal digits. A long number is split in two by dividing it by 10^(9*2^k) for the largest k that leaves a
+	 * quotient, and each half is turned into digits the same way, the remainder padded with zeros to 9*2^k digits.
+	 * Each division costs about as much as one pass of dividing the whole number by 10^9 did, and there are only
+	 * log2 of the number of limbs levels of them rather than one pass per 9 digits
+	 */
+	string toString() const {
+		if (limbs.empty())
+			return "0";
+		//powers[k] is 10^(9*2^k)
+		vector<vector<uint32_t> > powers(1, vector<uint32_t>(1, 1000000000));
+		while (powers.back().size() * 2 <= limbs.size())
+			powers.push_back(multiply(powers.back(), powers.back()));
+		string res;
+		appendDigits(limbs, powers, powers.size() - 1, 0, res);
+		return res;
+	}
+
+private:
+	static int digitValue(char c) {
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		return -1;
+	}
+
+	/* append the digits of n to res, padded with zeros to pad digits (none if pad is 0), splitting n by powers[k] and
+	 * the smaller powers
+	 */
+	static void appendDigits(const vector<uint32_t> &n, const vector<vector<uint32_t> > &powers, int k, size_t pad, string &res) {
+		//below about 32 limbs, dividing by 10^9 over and over is quicker than splitting
+		while (k >= 0 && (n.size() < 32 || less(n, powers[k])))
+			k--;
+		if (k < 0) {
+			appendChunks(n, pad, res);
+			return;
+		}
+		vector<uint32_t> q, r;
+		divMod(n, powers[k], q, r);
+		size_t low = (size_t)9 << k;
+		appendDigits(q, powers, k - 1, pad > low ? pad - low : 0, res);
+		appendDigits(r, powers, k - 1, low, res);
+	}
+
+	//append the digits of n to res, padded as for appendDigits, found 9 at a time by dividing all the limbs by 10^9
+	static void appendChunks(vector<uint32_t> rest, size_t pad, string &res) {
+		vector<uint32_t> chunks;
+		while (!rest.empty()) {
+			uint64_t rem = 0;
+			for (size_t i = rest.size(); i-- > 0; ) {
+				uint64_t cur = (rem << 32) | rest[i];
+				rest[i] = (uint32_t)(cur / 1000000000);
+				rem = cur % 1000000000;
+			}
+			chunks.push_back((uint32_t)rem);
+			while (!rest.empty() && rest.back() == 0)
+				rest.pop_back();
+		}
+		string digits;
+		if (!chunks.empty()) {
+			digits = to_string(chunks.back());
+			char chunk[10];
+			for (size_t i = chunks.size() - 1; i-- > 0; ) {
+				snprintf(chunk, sizeof(chunk), "%09u", chunks[i]);
+				digits += chunk;
+			}
+		}
+		if (digits.size() < pad)
+			res.append(pad - digits.size(), '0');
+		res += digits;
+	}
+
+	//whether a < b, for trimmed limbs
+	static bool less(const vector<uint32_t> &a, const vector<uint32_t> &b) {
+		if (a.size() != b.size())
+			return a.size() < b.size();
+		for (size_t i = a.size(); i-- > 0; )
+			if (a[i] != b[i])
+				return a[i] < b[i];
+		return false;
+	}
+
+	static vector<uint32_t> multiply(const vector<uint32_t> &a, const vector<uint32_t> &b) {
+		vector<uint32_t> res(a.size() + b.size(), 0);
+		for (size_t i = 0; i < a.size(); i++) {
+			uint64_t carry = 0;
+			for (size_t j = 0; j < b.size(); j++) {
+				uint64_t cur = (uint64_t)a[i] * b[j] + res[i + j] + carry;
+				res[i + j] = (uint32_t)cur;
+				carry = cur >> 32;
+			}
+			res[i + b.size()] = (uint32_t)carry;
+		}
+		while (!res.empty() && res.back() == 0)
+			res.pop_back();
+		return res;
+	}
+
+	/* q = u / v and r = u % v by long division a limb at a time (Knuth's algorithm D), for trimmed limbs with v
+	 * at least 2 limbs long. v is shifted so its top bit is set, which keeps each guess of a quotient limb from being
+	 * more than 2 too big
+	 */
+	static void divMod(const vector<uint32_t> &u, const vector<uint32_t> &v, vector<uint32_t> &q, vector<uint32_t> &r) {
+		size_t n = v.size();
+		if (u.size() < n) {
+			q.clear();
+			r = u;
+			return;
+		}
+		size_t m = u.size() - n;
+		int shift = __builtin_clz(v.back());
+		vector<uint32_t> vn(n), un(u.size() + 1);
+		for (size_t i = n; i-- > 0; )
+			vn[i] = (v[i] << shift) | (shift && i > 0 ? v[i - 1] >> (32 - shift) : 0);
+		un[u.size()] = shift ? u.back() >> (32 - shift) : 0;
+		for (size_t i = u.size(); i-- > 0; )
+			un[i] = (u[i] << shift) | (shift && i > 0 ? u[i - 1] >> (32 - shift) : 0);
+		q.assign(m + 1, 0);
+		for (size_t j = m + 1; j-- > 0; ) {
+			uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+			uint64_t qhat = num / vn[n - 1], rhat = num % vn[n - 1];
+			while (qhat >> 32 || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+				qhat--;
+				rhat += vn[n - 1];
+				if (rhat >> 32)
+					break;
+			}
+			//subtract qhat * vn from the top of un, adding vn back if that went below zero
+			int64_t borrow = 0, t;
+			for (size_t i = 0; i < n; i++) {
+				uint64_t p = qhat * vn[i];
+				t = (int64_t)un[i + j] - borrow - (int64_t)(p & 0xFFFFFFFF);
+				un[i + j] = (uint32_t)t;
+				borrow = (int64_t)(p >> 32) - (t >> 32);
+			}
+			t = (int64_t)un[j + n] - borrow;
+			un[j + n] = (uint32_t)t;
+			q[j] = (uint32_t)qhat;
+			if (t < 0) {
+				q[j]--;
+				uint64_t carry = 0;
+				for (size_t i = 0; i < n; i++) {
+					uint64_t sum = (uint64_t)un[i + j] + vn[i] + carry;
+					un[i + j] = (uint32_t)sum;
+					carry = sum >> 32;
+				}
+				un[j + n] += (uint32_t)carry;
+			}
+		}
+		r.resize(n);
+		for (size_t i = 0; i < n; i++)
+			r[i] = (un[i] >> shift) | (shift ? (uint32_t)((uint64_t)un[i + 1] << (32 - shift)) : 0);
+		while (!q.empty() && q.back() == 0)
+			q.pop_back();
+		while (!r.empty() && r.back() == 0)
+			r.pop_back();
+	}
+
+	//this = this * mul + add
+	void mulAdd(uint32_t mul, uint32_t add) {
+		uint64_t carry = add;
+		for (size_t i = 0; i < limbs.size(); i++) {
+			uint64_t cur = (uint64_t)limbs[i] * mul + carry;
+			limbs[i] = (uint32_t)cur;
+			carry = cur >> 32;
+		}
+		if (carry)
+			limbs.push_back((uint32_t)carry);
+	}
+
+	void trim() {
+		while (!limbs.empty() && limbs.back() == 0)
+			limbs.pop_back();
+	}
+
+	vector<uint32_t> limbs;
+};
+
+/* make a number into a vector of chars representing its reverse binary 
  * form up to and including its most significant bit
  * ex. binVector(6) produces a vector containing (in order) '0', '1', '1' 
  */
-std::vector<char> binVector(unsigned int x) {
-	int bit;
-	vector<char> res;
-	while (x != 0) {
-		bit = x & 1;
-		res.push_back(to_string(bit).at(0));
-		x = x >> 1;
+std::vector<char> binVector(const BigNum &x) {
+	vector<char> res;
+	for (size_t i = 0; i < x.bitLength(); i++)
+		res.push_back(x.bit(i) ? '1' : '0');
+	if (res.size() == 0) {
+		res.push_back('0');
+	}
+	return res;
+}
+
+//convert a vector of '0' and '1' chars to the number it represents
+BigNum vecToNum(const vector<char> &vec) {
+	return BigNum::fromBits(vec.data(), vec.size());
+}
+
+//write to the tape at an index, even if the tape hasn't reached that size before
+template <class Tape>
+void writeSafe(Tape &tape, char write, TapeIdx idx) {
+	if (idx >= (TapeIdx)tape.size())
+		tape.resize(idx + 1, 'B');
+	tape[idx] = write;
+}
+
+/* Buffers of freed tapes, kept for the next tapes made on the same thread instead of going back to the allocator.
+ * A tape takes one when it is told how many cells it will need (reserveTape) and gives its buffer back when it goes
+ * away, so the runs of a batch on one worker, or bench's repeated runs, use the same memory over and over rather
+ * than having it allocated, grown and paged in again each time. Each thread has its own pool, so there is no lock.
+ * Only a few buffers are kept, none bigger than MAX_POOLED bytes.
+ */
+template <class T>
+class BufferPool {
+public:
+	static const size_t MAX_BUFFERS = 8;
+	static const size_t MAX_POOLED = (size_t)256 << 20;
+
+	static BufferPool &local() {
+		static thread_local BufferPool pool;
+		return pool;
+	}
+	//an empty buffer with room for n items: the smallest kept one that has it, or else the biggest, grown
+	vector<T> take(size_t n) {
+		size_t pick = kept.size();
+		for (size_t i = 0; i < kept.size(); i++) {
+			bool fits = kept[i].capacity() >= n;
+			if (pick == kept.size() || (fits ? kept[pick].capacity() < n || kept[i].capacity() < kept[pick].capacity()
+					: kept[pick].capacity() < n && kept[i].capacity() > kept[pick].capacity()))
+				pick = i;
+		}
+		vector<T> res;
+		if (pick < kept.size()) {
+			res.swap(kept[pick]);
+			kept.erase(kept.begin() + pick);
+		}
+		res.reserve(n);
+		return res;
+	}
+	//keep a buffer that is no longer used, in place of the smallest one kept if there are already enough
+	void give(vector<T> &buf) {
+		if (buf.capacity() == 0 || buf.capacity() * sizeof(T) > MAX_POOLED)
+			return;
+		buf.clear();
+		if (kept.size() == MAX_BUFFERS) {
+			size_t smallest = 0;
+			for (size_t i = 1; i < kept.size(); i++)
+				if (kept[i].capacity() < kept[smallest].capacity())
+					smallest = i;
+			if (kept[smallest].capacity() >= buf.capacity())
+				return;
+			kept.erase(kept.begin() + smallest);
+		}
+		kept.push_back(vector<T>());
+		kept.back().swap(buf);
+	}
+
+private:
+	vector<vector<T> > kept;
+};
+
+/* A tape for the alphabet '0', '1', 'B' that stores each cell in 2 bits, 32
+ * cells to a 64 bit word. Indexing it reads and writes chars the same way as a
+ * vector<char> tape, so the states work on either, while blankRight, blankLeft
+ * and copyUntilBlank below handle a whole word of cells per operation.
+ * Cells past the end of the tape in the last word are always kept blank.
+ */
+class PackedTape {
+public:
+	//stands in for a char& to one cell
+	class Cell {
+	public:
+		Cell(uint64_t &word, unsigned shift) : word(word), shift(shift) {}
+		operator char() const {
+			return decode((unsigned)(word >> shift) & 3);
+		}
+		Cell &operator=(char c) {
+			word = (word & ~((uint64_t)3 << shift)) | ((uint64_t)encode(c) << shift);
+			return *this;
+		}
+		Cell &operator=(const Cell &other) {
+			return *this = (char)other;
+		}
+	private:
+		uint64_t &word;
+		unsigned shift;
+	};
+
+	static const unsigned CELLS_PER_WORD = 32;
+	//code of a cell, repeated over a whole word
+	static const uint64_t ZEROS = 0;
+	static const uint64_t ONES = 0x5555555555555555ULL;
+	static const uint64_t BLANKS = 0xAAAAAAAAAAAAAAAAULL;
+
+	static unsigned encode(char c) {
+		return c == '0' ? 0 : c == '1' ? 1 : 2;
+	}
+	static char decode(unsigned code) {
+		return "01BB"[code];
+	}
+
+	PackedTape() : len(0) {}
+	PackedTape(const PackedTape &) = default;
+	PackedTape(PackedTape &&) = default;
+	PackedTape &operator=(const PackedTape &) = default;
+	PackedTape &operator=(PackedTape &&) = default;
+	~PackedTape() {
+		BufferPool<uint64_t>::local().give(words);
+	}
+
+	size_t size() const {
+		return len;
+	}
+	char operator[](size_t idx) const {
+		return decode((unsigned)(words[idx / CELLS_PER_WORD] >> shiftOf(idx)) & 3);
+	}
+	Cell operator[](size_t idx) {
+		return Cell(words[idx / CELLS_PER_WORD], shiftOf(idx));
+	}
+	void push_back(char c) {
+		resize(len + 1);
+		(*this)[len - 1] = c;
+	}
+	void resize(size_t n, char fill = 'B') {
+		if (n < len) {
+			len = n;
+			words.resize((n + CELLS_PER_WORD - 1) / CELLS_PER_WORD);
+			clearTail();
+			return;
+		}
+		size_t old_len = len;
+		len = n;
+		words.resize((n + CELLS_PER_WORD - 1) / CELLS_PER_WORD, BLANKS);
+		if (fill != 'B')
+			for (size_t i = old_len; i < n; i++)
+				(*this)[i] = fill;
+	}
+
+	//remove the first n cells, shifting the rest of the tape to the start
+	void eraseFront(size_t n) {
+		if (n >= len) {
+			resize(0);
+			return;
+		}
+		size_t new_len = len - n;
+		for (size_t i = 0; i < new_len; i += CELLS_PER_WORD)
+			words[i / CELLS_PER_WORD] = get32(n + i);
+		len = new_len;
+		words.resize((new_len + CELLS_PER_WORD - 1) / CELLS_PER_WORD);
+		clearTail();
+	}
+
+	//index of the first cell at or right of idx holding c, or the size of the tape if there is none
+	size_t findRight(size_t idx, char c) const {
+		uint64_t pattern = ONES * encode(c);
+		size_t w = idx / CELLS_PER_WORD;
+		//ignore the cells of the first word that are left of idx
+		uint64_t skip = ~0ULL << shiftOf(idx);
+		for (; w < words.size(); w++, skip = ~0ULL) {
+			uint64_t found = matches(words[w], pattern) & skip;
+			if (found) {
+				size_t res = w * CELLS_PER_WORD + ctz64(found) / 2;
+				return res < len ? res : len;
+			}
+		}
+		return len;
+	}
+
+	//index of the first cell at or left of idx holding c, or -1 if there is none
+	long long findLeft(size_t idx, char c) const {
+		uint64_t pattern = ONES * encode(c);
+		long long w = idx / CELLS_PER_WORD;
+		//ignore the cells of the first word that are right of idx
+		uint64_t keep = ~0ULL >> (62 - shiftOf(idx));
+		for (; w >= 0; w--, keep = ~0ULL) {
+			uint64_t found = matches(words[w], pattern) & keep;
+			if (found)
+				return w * CELLS_PER_WORD + (63 - clz64(found)) / 2;
+		}
+		return -1;
+	}
+
+	//copy n cells of src starting at from into this tape starting at to, which must already be long enough
+	void copyFrom(const PackedTape &src, size_t from, size_t n, size_t to) {
+		while (n > 0) {
+			unsigned count = n < CELLS_PER_WORD ? n : CELLS_PER_WORD;
+			put(to, src.get32(from), count);
+			from += count;
+			to += count;
+			n -= count;
+		}
+	}
+
+	//make room for n cells, with a buffer from the thread's pool if the tape hasn't got one yet
+	void reserve(size_t n) {
+		size_t n_words = (n + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+		if (words.capacity() == 0)
+			words = BufferPool<uint64_t>::local().take(n_words);
+		else
+			words.reserve(n_words);
+	}
+
+	//unpack the cells into chars
+	const vector<char> &cells() const {
+		unpacked.resize(len);
+		for (size_t i = 0; i < len; i++)
+			unpacked[i] = (*this)[i];
+		return unpacked;
+	}
+
+private:
+	static unsigned shiftOf(size_t idx) {
+		return 2 * (idx % CELLS_PER_WORD);
+	}
+
+	//a word with the low bit of every 2 bit cell that equals the pattern's code set
+	static uint64_t matches(uint64_t word, uint64_t pattern) {
+		uint64_t diff = word ^ pattern;
+		return ~(diff | (diff >> 1)) & ONES;
+	}
+
+	static unsigned ctz64(uint64_t v) {
+		return __builtin_ctzll(v);
+	}
+	static unsigned clz64(uint64_t v) {
+		return __builtin_clzll(v);
+	}
+
+	//the 32 cells starting at idx, as one word (cells past the last word read as 0)
+	uint64_t get32(size_t idx) const {
+		size_t w = idx / CELLS_PER_WORD;
+		unsigned shift = shiftOf(idx);
+		uint64_t res = words[w] >> shift;
+		if (shift && w + 1 < words.size())
+			res |= words[w + 1] << (64 - shift);
+		return res;
+	}
+
+	//overwrite count cells starting at idx with the low cells of v
+	void put(size_t idx, uint64_t v, unsigned count) {
+		size_t w = idx / CELLS_PER_WORD;
+		unsigned shift = shiftOf(idx);
+		uint64_t mask = count == CELLS_PER_WORD ? ~0ULL : ((1ULL << (2 * count)) - 1);
+		v &= mask;
+		words[w] = (words[w] & ~(mask << shift)) | (v << shift);
+		if (shift && 2 * count + shift > 64)
+			words[w + 1] = (words[w + 1] & ~(mask >> (64 - shift))) | (v >> (64 - shift));
+	}
+
+	//make the cells past the end of the tape in the last word blank
+	void clearTail() {
+		if (len % CELLS_PER_WORD == 0)
+			return;
+		uint64_t mask = ~0ULL << shiftOf(len);
+		words.back() = (words.back() & ~mask) | (BLANKS & mask);
+	}
+
+	vector<uint64_t> words;
+	size_t len;
+	mutable vector<char> unpacked;
+};
+
+const uint64_t PackedTape::ZEROS;
+const uint64_t PackedTape::ONES;
+const uint64_t PackedTape::BLANKS;
+
+TapeView view(const PackedTape &tape) {
+	return view(tape.cells());
+}
+
+//remove the cells before idx from a tape
+void eraseFront(vector<char> &tape, size_t idx) {
+	tape.erase(tape.begin(), tape.begin() + idx);
+}
+
+void eraseFront(PackedTape &tape, size_t idx) {
+	tape.eraseFront(idx);
+}
+
+//make room in a tape for the given number of cells up front, so it doesn't have to grow as it fills
+void reserveTape(vector<char> &tape, size_t cells) {
+	tape.reserve(cells);
+}
+
+void reserveTape(PackedTape &tape, size_t cells) {
+	tape.reserve(cells);
+}
+
+//a tape's cells as chars
+const vector<char> &cells(const vector<char> &tape) {
+	return tape;
+}
+
+const vector<char> &cells(const PackedTape &tape) {
+	return tape.cells();
+}
+
+/* A tape of one char per cell whose first cell doesn't have to be at the start
+ * of its buffer. The native machines run on it by default. Cells cut off the
+ * front (as each machine does when it halts) only move the origin, which takes
+ * constant time instead of shifting the whole tape the way erasing from a
+ * vector does. The cells are always contiguous, so scans and copies work on
+ * them directly. The machines never move left of cell 0, so the tape only
+ * grows to the right.
+ */
+class OriginTape {
+public:
+	OriginTape() : origin(0) {}
+	OriginTape(const OriginTape &) = default;
+	OriginTape(OriginTape &&) = default;
+	OriginTape &operator=(const OriginTape &) = default;
+	OriginTape &operator=(OriginTape &&) = default;
+	~OriginTape() {
+		BufferPool<char>::local().give(buf);
+	}
+
+	size_t size() const {
+		return buf.size() - origin;
+	}
+	char operator[](size_t idx) const {
+		return buf[origin + idx];
+	}
+	char &operator[](size_t idx) {
+		return buf[origin + idx];
+	}
+	const char *data() const {
+		return buf.data() + origin;
+	}
+	char *data() {
+		return buf.data() + origin;
+	}
+	void push_back(char c) {
+		reclaim();
+		buf.push_back(c);
+	}
+	void resize(size_t n, char fill = 'B') {
+		if (n > size())
+			reclaim();
+		buf.resize(origin + n, fill);
+	}
+	//remove the first n cells
+	void eraseFront(size_t n) {
+		origin += min(n, size());
+	}
+	//make room for n cells, with a buffer from the thread's pool if the tape hasn't got one yet
+	void reserve(size_t n) {
+		if (buf.capacity() == 0)
+			buf = BufferPool<char>::local().take(origin + n);
+		else
+			buf.reserve(origin + n);
+	}
+	//the cells as a vector
+	const vector<char> &cells() const {
+		copied.assign(data(), data() + size());
+		return copied;
+	}
+
+private:
+	/* before the tape grows, give back the space of cells erased from the front once there are more of those than
+	 * cells left, which moves each cell at most once for every cell erased
+	 */
+	void reclaim() {
+		if (origin > size()) {
+			buf.erase(buf.begin(), buf.begin() + origin);
+			origin = 0;
+		}
+	}
+
+	vector<char> buf;
+	//where cell 0 is in buf
+	size_t origin;
+	mutable vector<char> copied;
+};
+
+TapeView view(const OriginTape &tape) {
+	TapeView v = {tape.data(), tape.size()};
+	return v;
+}
+
+void eraseFront(OriginTape &tape, size_t idx) {
+	tape.eraseFront(idx);
+}
+
+void reserveTape(OriginTape &tape, size_t cells) {
+	tape.reserve(cells);
+}
+
+const vector<char> &cells(const OriginTape &tape) {
+	return tape.cells();
+}
+
+/* A tape whose cells are kept in a memory-mapped file instead of on the heap
+ * (-mapped), so it can grow larger than physical memory: the kernel writes
+ * cells that haven't been used lately out to the file and reads them back when
+ * they are. The file is sparse and is unlinked as soon as it is made. A range
+ * of addresses is reserved for the tape, and growing it extends the file and
+ * maps the new part right after the old one, a chunk at a time. A tape that
+ * outgrows its addresses has the file mapped again at twice as many, so unlike
+ * a vector the cells are never copied.
+ */
+class MappedTape {
+public:
+	//where the files behind mapped tapes are made
+	static string directory;
+	//the file is extended in multiples of this many cells
+	static const size_t CHUNK = (size_t)64 << 20;
+	//the addresses first reserved for a tape
+	static const size_t RESERVE = 4 * CHUNK;
+
+	MappedTape() : base(nullptr), len(0), mapped(0), reserved(0), fd(-1) {}
+	MappedTape(MappedTape &&other) : base(other.base), len(other.len), mapped(other.mapped), reserved(other.reserved), fd(other.fd) {
+		other.base = nullptr;
+		other.len = other.mapped = other.reserved = 0;
+		other.fd = -1;
+	}
+	MappedTape &operator=(MappedTape &&other) {
+		swap(base, other.base);
+		swap(len, other.len);
+		swap(mapped, other.mapped);
+		swap(reserved, other.reserved);
+		swap(fd, other.fd);
+		return *this;
+	}
+	MappedTape(const MappedTape &) = delete;
+	MappedTape &operator=(const MappedTape &) = delete;
+	~MappedTape() {
+		if (base)
+			munmap(base, reserved);
+		if (fd >= 0)
+			::close(fd);
+	}
+
+	size_t size() const {
+		return len;
+	}
+	char operator[](size_t idx) const {
+		return base[idx];
+	}
+	char &operator[](size_t idx) {
+		return base[idx];
+	}
+	const char *data() const {
+		return base;
+	}
+	char *data() {
+		return base;
+	}
+	void push_back(char c) {
+		resize(len + 1, c);
+	}
+	void resize(size_t n, char fill = 'B') {
+		if (n > mapped)
+			grow(n);
+		if (n > len)
+			memset(base + len, fill, n - len);
+		len = n;
+	}
+
+	//remove the first n cells, shifting the rest of the tape to the start
+	void eraseFront(size_t n) {
+		if (n >= len) {
+			len = 0;
+			return;
+		}
+		memmove(base, base + n, len - n);
+		len -= n;
+	}
+
+private:
+	//make the file, on the first resize so tapes that stay empty cost nothing
+	void open() {
+		string name = directory + "/tmsim_tape_XXXXXX";
+		vector<char> path(name.begin(), name.end());
+		path.push_back('\0');
+		fd = mkstemp(path.data());
+		if (fd < 0)
+			throw runtime_error("Could not make a file for a mapped tape in \'" + directory + "\'");
+		unlink(path.data());
+	}
+
+	/* move the tape to a new range of size addresses. Only the addresses change: the file is mapped again at the new
+	 * ones, so the cells aren't copied, and the old ones are given back.
+	 */
+	void reserve(size_t size) {
+		void *p = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (p == MAP_FAILED)
+			throw runtime_error("Could not reserve " + to_string(size >> 20) + " MB of addresses for a mapped tape");
+		if (mapped > 0 && mmap(p, mapped, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+			munmap(p, size);
+			throw runtime_error("Could not map a mapped tape again at " + to_string(size >> 20) + " MB of addresses");
+		}
+		if (base)
+			munmap(base, reserved);
+		base = (char *)p;
+		reserved = size;
+	}
+
+	void grow(size_t n) {
+		if (fd < 0)
+			open();
+		size_t want = (n + CHUNK - 1) / CHUNK * CHUNK;
+		//twice as many addresses as the tape needs, so it moves only a few times however large it gets
+		if (want > reserved)
+			reserve(max(want, max(2 * reserved, RESERVE)));
+		if (ftruncate(fd, want) != 0
+			|| mmap(base + mapped, want - mapped, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, mapped) == MAP_FAILED)
+			throw runtime_error("Could not grow a mapped tape in \'" + directory + "\' to " + to_string(want >> 20) + " MB");
+		mapped = want;
+	}
+
+	char *base;
+	size_t len;
+	//cells backed by the file so far
+	size_t mapped;
+	size_t reserved;
+	int fd;
+};
+
+string MappedTape::directory = ".";
+const size_t MappedTape::CHUNK;
+const size_t MappedTape::RESERVE;
+
+TapeView view(const MappedTape &tape) {
+	TapeView v = {tape.data(), tape.size()};
+	return v;
+}
+
+void eraseFront(MappedTape &tape, size_t idx) {
+	tape.eraseFront(idx);
+}
+
+//a mapped tape already grows without copying its cells
+void reserveTape(MappedTape &, size_t) {}
+
+//index of the first blank at or right of idx (the tape is blank past its end)
+template <class Tape>
+TapeIdx blankRight(const Tape &tape, TapeIdx idx) {
+	while (idx < (TapeIdx)tape.size() && tape[idx] != 'B')
+		idx++;
+	return idx;
+}
+
+TapeIdx blankRight(const PackedTape &tape, TapeIdx idx) {
+	return tape.findRight(idx, 'B');
+}
+
+//index of the first blank at or left of idx, or -1 if there is none (every tape the machines make begins with one)
+template <class Tape>
+TapeIdx blankLeft(const Tape &tape, TapeIdx idx) {
+	while (idx >= 0 && tape[idx] != 'B')
+		idx--;
+	return idx;
+}
+
+TapeIdx blankLeft(const PackedTape &tape, TapeIdx idx) {
+	return tape.findLeft(idx, 'B');
+}
+
+/* Searches for one symbol in a run of char cells, 16 or 32 cells per compare
+ * with SSE2 or AVX2 where the CPU has them and a cell at a time otherwise.
+ * AVX2 is picked at run time, so the binary doesn't need to be built for it.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define TMSIM_SIMD_SCAN 1
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+size_t findCellRightAVX2(const char *cells, size_t from, size_t to, char c) {
+	const __m256i target = _mm256_set1_epi8(c);
+	for (; from + 32 <= to; from += 32) {
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(cells + from)), target));
+		if (mask)
+			return from + __builtin_ctz(mask);
+	}
+	for (; from < to; from++)
+		if (cells[from] == c)
+			return from;
+	return to;
+}
+
+__attribute__((target("avx2")))
+long long findCellLeftAVX2(const char *cells, long long from, char c) {
+	const __m256i target = _mm256_set1_epi8(c);
+	//from is the last cell to look at, so the block is the 32 cells ending there
+	for (; from >= 31; from -= 32) {
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(cells + from - 31)), target));
+		if (mask)
+			return from - __builtin_clz(mask);
+	}
+	for (; from >= 0; from--)
+		if (cells[from] == c)
+			return from;
+	return -1;
+}
+
+size_t findCellRightSSE2(const char *cells, size_t from, size_t to, char c) {
+	const __m128i target = _mm_set1_epi8(c);
+	for (; from + 16 <= to; from += 16) {
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(cells + from)), target));
+		if (mask)
+			return from + __builtin_ctz(mask);
+	}
+	for (; from < to; from++)
+		if (cells[from] == c)
+			return from;
+	return to;
+}
+
+long long findCellLeftSSE2(const char *cells, long long from, char c) {
+	const __m128i target = _mm_set1_epi8(c);
+	for (; from >= 15; from -= 16) {
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(cells + from - 15)), target));
+		if (mask)
+			return from - (__builtin_clz(mask) - 16);
+	}
+	for (; from >= 0; from--)
+		if (cells[from] == c)
+			return from;
+	return -1;
+}
+
+bool haveAVX2() {
+	static const bool res = __builtin_cpu_supports("avx2");
+	return res;
+}
+#endif
+
+//index of the first cell in [from, to) equal to c, or to if there is none
+size_t findCellRight(const char *cells, size_t from, size_t to, char c) {
+#ifdef TMSIM_SIMD_SCAN
+	if (haveAVX2())
+		return findCellRightAVX2(cells, from, to, c);
+	return findCellRightSSE2(cells, from, to, c);
+#else
+	for (; from < to; from++)
+		if (cells[from] == c)
+			return from;
+	return to;
+#endif
+}
+
+//index of the last cell in [0, from] equal to c, or -1 if there is none
+long long findCellLeft(const char *cells, long long from, char c) {
+#ifdef TMSIM_SIMD_SCAN
+	if (haveAVX2())
+		return findCellLeftAVX2(cells, from, c);
+	return findCellLeftSSE2(cells, from, c);
+#else
+	for (; from >= 0; from--)
+		if (cells[from] == c)
+			return from;
+	return -1;
+#endif
+}
+
+TapeIdx blankRight(const vector<char> &tape, TapeIdx idx) {
+	return findCellRight(tape.data(), idx, tape.size(), 'B');
+}
+
+TapeIdx blankLeft(const vector<char> &tape, TapeIdx idx) {
+	return findCellLeft(tape.data(), idx, 'B');
+}
+
+//copy len cells of src starting at from to dst starting at to, which must already be long enough
+template <class Tape>
+void copyCells(const Tape &src, TapeIdx from, TapeIdx len, Tape &dst, TapeIdx to) {
+	for (TapeIdx i = 0; i < len; i++)
+		dst[to + i] = src[from + i];
+}
+
+void copyCells(const vector<char> &src, TapeIdx from, TapeIdx len, vector<char> &dst, TapeIdx to) {
+	memmove(dst.data() + to, src.data() + from, len);
+}
+
+void copyCells(const PackedTape &src, TapeIdx from, TapeIdx len, PackedTape &dst, TapeIdx to) {
+	dst.copyFrom(src, from, len, to);
+}
+
+TapeIdx blankRight(const MappedTape &tape, TapeIdx idx) {
+	return findCellRight(tape.data(), idx, tape.size(), 'B');
+}
+
+TapeIdx blankLeft(const MappedTape &tape, TapeIdx idx) {
+	return findCellLeft(tape.data(), idx, 'B');
+}
+
+void copyCells(const MappedTape &src, TapeIdx from, TapeIdx len, MappedTape &dst, TapeIdx to) {
+	memmove(dst.data() + to, src.data() + from, len);
+}
+
+TapeIdx blankRight(const OriginTape &tape, TapeIdx idx) {
+	return findCellRight(tape.data(), idx, tape.size(), 'B');
+}
+
+TapeIdx blankLeft(const OriginTape &tape, TapeIdx idx) {
+	return findCellLeft(tape.data(), idx, 'B');
+}
+
+void copyCells(const OriginTape &src, TapeIdx from, TapeIdx len, OriginTape &dst, TapeIdx to) {
+	memmove(dst.data() + to, src.data() + from, len);
+}
+
+/* Results of the add and mult machines where mult and exp run them as one
+ * black box state (Add* and Mult*). Such a run always starts at cell 1 and
+ * never reads past the blank after its last input, so it depends only on the
+ * cells up to that blank, and an earlier run from the same cells can be
+ * replayed by writing back the cells it left, moving the head to where it
+ * stopped and counting the steps it took. Once the entries take up more than
+ * max_bytes the least recently used ones are dropped. One cache can be shared
+ * by simulations running on different threads.
+ */
+class ResultCache {
+public:
+	struct Result {
+		//the cells from 0 up to the last one the run wrote
+		string cells;
+		TapeIdx head;
+		unsigned long long steps;
+		//for mult, the cells it left on its add tape in the same way (empty if it never used it)
+		string aux;
+	};
+
+	explicit ResultCache(size_t max_bytes) : max_bytes(max_bytes), bytes(0), lookups(0), hits(0), evictions(0) {}
+
+	//look up the result of a run from the cells in key, making it the most recently used one
+	bool find(const string &key, Result &res) {
+		lock_guard<mutex> lock(mtx);
+		lookups++;
+		unordered_map<string, list<Entry>::iterator>::iterator it = index.find(key);
+		if (it == index.end())
+			return false;
+		hits++;
+		entries.splice(entries.begin(), entries, it->second);
+		res = it->second->res;
+		return true;
+	}
+
+	void insert(const string &key, const Result &res) {
+		//the key is kept twice, in the entry and the index
+		size_t size = 2 * key.size() + res.cells.size() + res.aux.size() + sizeof(Entry);
+		lock_guard<mutex> lock(mtx);
+		if (size > max_bytes || index.count(key))
+			return;
+		Entry entry = {key, res, size};
+		entries.push_front(entry);
+		index[key] = entries.begin();
+		bytes += size;
+		while (bytes > max_bytes) {
+			bytes -= entries.back().size;
+			index.erase(entries.back().key);
+			entries.pop_back();
+			evictions++;
+		}
+	}
+
+	string stats() {
+		lock_guard<mutex> lock(mtx);
+		char rate[16];
+		snprintf(rate, sizeof(rate), "%.1f%%", lookups ? 100.0 * hits / lookups : 0.0);
+		return "Cache: " + to_string(hits) + " of " + to_string(lookups) + " lookups hit (" + rate + "), "
+			+ to_string(evictions) + " evicted, " + to_string(entries.size()) + " entries in " + to_string(bytes) + " bytes";
+	}
+
+private:
+	struct Entry {
+		string key;
+		Result res;
+		size_t size;
+	};
+
+	size_t max_bytes;
+	size_t bytes;
+	unsigned long long lookups;
+	unsigned long long hits;
+	unsigned long long evictions;
+	//most recently used first
+	list<Entry> entries;
+	unordered_map<string, list<Entry>::iterator> index;
+	mutex mtx;
+};
+
+//a simulation's state as saved in a checkpoint file
+struct Checkpoint {
+	//what was run and how, as given on the command line
+	string operation;
+	string x, y;
+	string format;
+	unsigned keyframe_every;
+	bool packed;
+	//the directory of the files the tapes were mapped from, or empty if they weren't
+	string mapped;
+	bool accelerate;
+	TraceDetail detail;
+	//seconds between checkpoints
+	double every;
+	//empty if the run isn't traced
+	string trace_file;
+	//how much of the trace file had been written
+	unsigned long long trace_offset;
+	unsigned long long steps;
+	vector<vector<char> > tapes;
+	//the heads kept by each machine loop that was running, outermost first
+	vector<vector<TapeIdx> > heads;
+	//what the tracer needs to carry on
+	string tracer;
+	Checkpoint() : keyframe_every(4096), packed(false), accelerate(true), every(0), trace_offset(0), steps(0) {}
+};
+
+const char CHECKPOINT_MAGIC[] = "TMSC";
+const unsigned char CHECKPOINT_VERSION = 5;
+
+void putString(string &out, const string &str) {
+	putVarint(out, str.size());
+	out += str;
+}
+
+string readString(DeltaReader &in) {
+	string str(in.varint(), '\0');
+	in.bytes(&str[0], str.size());
+	return str;
+}
+
+/* write a checkpoint to a temporary file and rename it over filename, so the file is always either the previous
+ * checkpoint or the new one, never part of one. Both the file and the rename are synced to the disk before it
+ * returns, so a crash of the whole system can't leave it half written either.
+ */
+void writeCheckpoint(const string &filename, const Checkpoint &cp, const vector<TapeView> &tapes) {
+	string tmp = filename + ".tmp";
+	ofstream file(tmp.c_str(), ios::binary);
+	string out(CHECKPOINT_MAGIC, 4);
+	out.push_back((char)CHECKPOINT_VERSION);
+	putString(out, cp.operation);
+	putString(out, cp.x);
+	putString(out, cp.y);
+	putString(out, cp.format);
+	putVarint(out, cp.keyframe_every);
+	out.push_back(cp.packed ? 1 : 0);
+	putString(out, cp.mapped);
+	out.push_back(cp.accelerate ? 1 : 0);
+	putVarint(out, zigzag(cp.detail.window));
+	putVarint(out, cp.detail.every);
+	out.push_back(cp.detail.transitions ? 1 : 0);
+	out.push_back(cp.detail.nested ? 1 : 0);
+	//the interval is kept to the bit, as rounding a short one down to 0 would stop a resumed run checkpointing
+	unsigned long long every_bits;
+	memcpy(&every_bits, &cp.every, sizeof every_bits);
+	putVarint(out, every_bits);
+	putString(out, cp.trace_file);
+	putVarint(out, cp.trace_offset);
+	putVarint(out, cp.steps);
+	putVarint(out, tapes.size());
+	//the cells go straight from the tapes to the file, as a mapped tape may not fit in memory twice
+	for (size_t i = 0; i < tapes.size(); i++) {
+		putVarint(out, tapes[i].len);
+		file.write(out.data(), out.size());
+		file.write(tapes[i].cells, tapes[i].len);
+		out.clear();
+	}
+	putVarint(out, cp.heads.size());
+	for (size_t i = 0; i < cp.heads.size(); i++) {
+		putVarint(out, cp.heads[i].size());
+		for (size_t h = 0; h < cp.heads[i].size(); h++)
+			putVarint(out, zigzag(cp.heads[i][h]));
+	}
+	putString(out, cp.tracer);
+	file.write(out.data(), out.size());
+	file.close();
+	size_t slash = filename.rfind('/');
+	string directory = slash == string::npos ? "." : filename.substr(0, slash ? slash : 1);
+	if (!file || !syncFile(tmp) || rename(tmp.c_str(), filename.c_str()) != 0 || !syncFile(directory))
+		throw runtime_error("Could not write checkpoint '" + filename + "'");
+}
+
+void readCheckpoint(const string &filename, Checkpoint &cp) {
+	ifstream file(filename.c_str(), ios::binary);
+	if (!file)
+		throw runtime_error("Could not open checkpoint '" + filename + "'");
+	DeltaReader in(file, "checkpoint '" + filename + "'");
+	char magic[4];
+	in.bytes(magic, 4);
+	if (memcmp(magic, CHECKPOINT_MAGIC, 4) != 0 || in.byte() != CHECKPOINT_VERSION)
+		throw runtime_error("'" + filename + "' is not a checkpoint from this version of tmsim");
+	cp.operation = readString(in);
+	cp.x = readString(in);
+	cp.y = readString(in);
+	cp.format = readString(in);
+	cp.keyframe_every = in.varint();
+	cp.packed = in.byte() != 0;
+	cp.mapped = readString(in);
+	cp.accelerate = in.byte() != 0;
+	cp.detail.window = unzigzag(in.varint());
+	cp.detail.every = in.varint();
+	cp.detail.transitions = in.byte() != 0;
+	cp.detail.nested = in.byte() != 0;
+	unsigned long long every_bits = in.varint();
+	memcpy(&cp.every, &every_bits, sizeof cp.every);
+	cp.trace_file = readString(in);
+	cp.trace_offset = in.varint();
+	cp.steps = in.varint();
+	cp.tapes.resize(in.varint());
+	for (size_t i = 0; i < cp.tapes.size(); i++) {
+		cp.tapes[i].resize(in.varint());
+		in.bytes(cp.tapes[i].data(), cp.tapes[i].size());
+	}
+	cp.heads.resize(in.varint());
+	for (size_t i = 0; i < cp.heads.size(); i++) {
+		cp.heads[i].resize(in.varint());
+		for (size_t h = 0; h < cp.heads[i].size(); h++)
+			cp.heads[i][h] = unzigzag(in.varint());
+	}
+	cp.tracer = readString(in);
+}
+
+/* The index written next to a text trace, in [trace file].idx, so that -replay can find the record of a step
+ * without reading the trace up to it. The records are listed in blocks of INDEX_BLOCK bytes, which lets the block
+ * with a given step be found by a binary search of the file:
+ *
+ *   file:   "TMSI" version 0 0 0 block...
+ *   block:  first_step first_offset count (step_gap offset_gap kind)... padding
+ *
+ * The last block stops after its last record, without the padding.
+ *
+ * first_step and first_offset are 8 byte and count a 4 byte little endian number. The gaps are varints, from the
+ * record before or from first_step and first_offset. A record's step is how many steps had been taken when it was
+ * written, and its offset is where it starts in the trace: a step or halt starts at the blank lines before its
+ * State: line, since the cells above that line are the tape it starts from.
+ */
+enum IndexKind {
+	INDEX_TEXT,
+	INDEX_STEP,
+	INDEX_HALT,
+	INDEX_CONFIG,
+	//set on a record whose state is another one than that of the record before
+	INDEX_TRANSITION = 4
+};
+
+const char INDEX_MAGIC[] = "TMSI";
+const unsigned char INDEX_VERSION = 1;
+const size_t INDEX_HEADER = 8;
+const size_t INDEX_BLOCK = 4096;
+//the most a record can take up in a block
+const size_t INDEX_MAX_RECORD = 21;
+
+void putFixed(string &out, unsigned long long v, int bytes) {
+	for (int i = 0; i < bytes; i++)
+		out.push_back((char)(v >> (8 * i)));
+}
+
+unsigned long long readFixed(const char *in, int bytes) {
+	unsigned long long v = 0;
+	for (int i = 0; i < bytes; i++)
+		v |= (unsigned long long)(unsigned char)in[i] << (8 * i);
+	return v;
+}
+
+//writes the index of the trace going to a FileTraceSink, a block at a time
+class TraceIndex {
+public:
+	//steps is the step count of the simulation being traced
+	TraceIndex(const string &filename, const FileTraceSink &trace, const unsigned long long &steps)
+		: filename(filename), trace(&trace), steps(&steps), blocks(0), count(0), last_step(0), last_offset(0) {}
+	//an index whose records are all given with put(), such as one put together from the indexes of parts of a trace
+	explicit TraceIndex(const string &filename)
+		: filename(filename), trace(nullptr), steps(nullptr), blocks(0), count(0), last_step(0), last_offset(0) {}
+
+	//add a record that starts skip bytes past what has been written to the trace so far
+	void add(int kind, size_t skip) {
+		put(*steps, trace->offset() + skip, kind);
+	}
+
+	//add a record of step that starts at offset in the trace
+	void put(unsigned long long step, unsigned long long offset, int kind) {
+		if (count == 0 || block.size() + INDEX_MAX_RECORD > INDEX_BLOCK) {
+			if (count > 0)
+				writeBlock();
+			block.clear();
+			putFixed(block, step, 8);
+			putFixed(block, offset, 8);
+			putFixed(block, 0, 4);
+			last_step = step;
+			last_offset = offset;
+		}
+		putVarint(block, step - last_step);
+		putVarint(block, offset - last_offset);
+		block.push_back((char)kind);
+		last_step = step;
+		last_offset = offset;
+		count++;
+	}
+
+	//write out the last block, without its padding; throws runtime_error if the index couldn't be written
+	void close() {
+		unsigned long long size = INDEX_HEADER + blocks * INDEX_BLOCK;
+		if (count > 0) {
+			size += block.size();
+			writeBlock(false);
+		}
+		open();
+		out.close();
+		//a resumed run can leave blocks the run before it wrote past its checkpoint
+		if (!out || truncate(filename.c_str(), size) != 0)
+			throw runtime_error("Could not write trace index \'" + filename + "\'");
+	}
+
+	void saveState(string &out) const {
+		putVarint(out, blocks);
+		putVarint(out, count);
+		putVarint(out, last_step);
+		putVarint(out, last_offset);
+		putString(out, block);
+	}
+	void loadState(DeltaReader &in) {
+		blocks = in.varint();
+		count = in.varint();
+		last_step = in.varint();
+		last_offset = in.varint();
+		block = readString(in);
+	}
+private:
+	//open the file, carrying on after the blocks already written if any were
+	void open() {
+		if (out.is_open())
+			return;
+		if (blocks == 0) {
+			out.open(filename.c_str(), ios::binary | ios::out | ios::trunc);
+			string header(INDEX_MAGIC, 4);
+			header.push_back((char)INDEX_VERSION);
+			header.append(3, '\0');
+			out.write(header.data(), header.size());
+		}
+		else {
+			out.open(filename.c_str(), ios::binary | ios::in | ios::out);
+			out.seekp(INDEX_HEADER + blocks * INDEX_BLOCK);
+		}
+		if (!out)
+			throw runtime_error("Could not open trace index \'" + filename + "\'");
+	}
+
+	void writeBlock(bool pad = true) {
+		open();
+		string count_bytes;
+		putFixed(count_bytes, count, 4);
+		block.replace(16, 4, count_bytes);
+		if (pad)
+			block.resize(INDEX_BLOCK, '\0');
+		out.write(block.data(), block.size());
+		blocks++;
+		count = 0;
+	}
+
+	string filename;
+	//the trace and step count add() takes records from, null for an index given them with put()
+	const FileTraceSink *trace;
+	const unsigned long long *steps;
+	fstream out;
+	unsigned long long blocks;
+	unsigned count;
+	unsigned long long last_step;
+	unsigned long long last_offset;
+	string block;
+};
+
+/* adds the records that go through it to the index of the trace the inner TextTracer writes. Without an index it
+ * only keeps track of the state of the last record, so that the checkpoints of an untraced run can start indexes
+ * that carry on from them (see runParallelTrace()).
+ */
+class IndexTracer : public Tracer {
+public:
+	IndexTracer(Tracer &inner, TraceIndex *index) : inner(inner), index(index), last_state(nullptr) {}
+	void text(const string &str) {
+		if (index)
+			index->add(INDEX_TEXT, 0);
+		inner.text(str);
+	}
+	void start(const char *state, TapeIdx idx) {
+		int kind = INDEX_STEP | transition(state);
+		if (index)
+			index->add(kind, 0);
+		inner.start(state, idx);
+	}
+	void step(const char *state, TapeIdx idx, TapeView tape) {
+		int kind = INDEX_STEP | transition(state);
+		if (index)
+			index->add(kind, TextTracer::cellsLength(tape));
+		inner.step(state, idx, tape);
+	}
+	void halt(TapeIdx idx, TapeView tape) {
+		int kind = INDEX_HALT | transition("Halt");
+		if (index)
+			index->add(kind, TextTracer::cellsLength(tape));
+		inner.halt(idx, tape);
+	}
+	void config(const char *state, const TracedTape *tapes, int count, bool initial) {
+		int kind = INDEX_CONFIG | transition(state);
+		if (index)
+			index->add(kind, 0);
+		inner.config(state, tapes, count, initial);
+	}
+	void saveState(string &out) const {
+		putString(out, last_name);
+		out.push_back(index ? 1 : 0);
+		if (index)
+			index->saveState(out);
+		inner.saveState(out);
+	}
+	//an index that the checkpoint has no state for starts out empty
+	void loadState(DeltaReader &in) {
+		last_name = readString(in);
+		last_state = nullptr;
+		if (in.byte() && index)
+			index->loadState(in);
+		inner.loadState(in);
+	}
+private:
+	//INDEX_TRANSITION if state isn't the state of the record before
+	int transition(const char *state) {
+		if (state == last_state)
+			return 0;
+		last_state = state;
+		if (last_name == state)
+			return 0;
+		last_name = state;
+		return INDEX_TRANSITION;
+	}
+
+	Tracer &inner;
+	TraceIndex *index;
+	//names are compared by pointer first, as a machine's states keep theirs
+	const char *last_state;
+	string last_name;
+};
+
+//thrown out of a simulation that has got to where its segment of the trace ends, see Checkpointer::stopAt()
+struct TraceSegmentEnd {};
+
+/* Takes a checkpoint of a native simulation every so often, and puts one back
+ * when a simulation is resumed. The simulation attaches its tapes, and each
+ * machine loop registers the heads it keeps in local variables for as long as
+ * it runs (see CheckpointFrame). Checkpoints are only taken at the top of
+ * those loops, where the tapes, heads, step count and trace so far are the
+ * whole state of the simulation.
+ */
+class Checkpointer {
+public:
+	//settings holds what was run and how; sink is null if the run isn't traced
+	Checkpointer(const string &filename, const Checkpoint &settings, FileTraceSink *sink, Tracer &trace)
+		: filename(filename), cp(settings), sink(sink), trace(trace), resume(nullptr), resume_frame(0), countdown(1),
+		step_interval(0), next_step(0), stop_at(0) {
+		next = chrono::steady_clock::now() + interval();
+	}
+
+	//take checkpoints every so many steps rather than every settings.every seconds
+	void setStepInterval(unsigned long long steps) {
+		next_step += steps - step_interval;
+		step_interval = steps;
+	}
+	//hand checkpoints to a function instead of writing them to the file
+	void keepWith(function<void(const Checkpoint &)> keeper) {
+		this->keeper = keeper;
+	}
+	//end the simulation by throwing TraceSegmentEnd at the first checkpoint at or after this many steps
+	void stopAt(unsigned long long steps) {
+		stop_at = steps;
+	}
+
+	//start the simulation from a checkpoint instead of its inputs
+	void resumeFrom(const Checkpoint &from) {
+		resume = &from;
+		resume_frame = 0;
+	}
+	//whether the simulation is being resumed and hasn't got back to where the checkpoint was taken yet
+	bool resuming() const {
+		return resume != nullptr;
+	}
+
+	//include a tape in checkpoints, filling it in from the checkpoint being resumed if there is one
+	template <class Tape>
+	void attach(Tape &tape) {
+		if (resume) {
+			const vector<char> &saved = resume->tapes.at(tapes.size());
+			tape.resize(0);
+			tape.resize(saved.size());
+			for (size_t i = 0; i < saved.size(); i++)
+				tape[i] = saved[i];
+		}
+		tapes.push_back([&tape]() { return view(tape); });
+	}
+
+	//a machine loop has started; returns whether its heads were set from the checkpoint being resumed
+	bool enter(const vector<TapeIdx *> &heads) {
+		frames.push_back(heads);
+		if (!resume)
+			return false;
+		const vector<TapeIdx> &saved = resume->heads.at(resume_frame);
+		for (size_t i = 0; i < heads.size() && i < saved.size(); i++)
+			*heads[i] = saved[i];
+		//the loop the checkpoint was taken in is where the simulation carries on as usual
+		if (++resume_frame == resume->heads.size())
+			resume = nullptr;
+		return true;
+	}
+	void leave() {
+		frames.pop_back();
+	}
+
+	//whether it is time for the next checkpoint; the clock is only looked at every so often
+	bool due(unsigned long long steps) {
+		if (stop_at && steps >= stop_at)
+			throw TraceSegmentEnd();
+		if (step_interval)
+			return steps >= next_step;
+		if (cp.every <= 0)
+			return false;
+		if (--countdown > 0)
+			return false;
+		countdown = 16;
+		return chrono::steady_clock::now() >= next;
+	}
+
+	void save(unsigned long long steps) {
+		if (sink) {
+			//the trace has to be on the disk up to the offset the checkpoint records
+			sink->sync();
+			cp.trace_offset = sink->offset();
+		}
+		cp.steps = steps;
+		vector<TapeView> views(tapes.size());
+		for (size_t i = 0; i < tapes.size(); i++)
+			views[i] = tapes[i]();
+		cp.heads.resize(frames.size());
+		for (size_t f = 0; f < frames.size(); f++) {
+			cp.heads[f].resize(frames[f].size());
+			for (size_t h = 0; h < frames[f].size(); h++)
+				cp.heads[f][h] = *frames[f][h];
+		}
+		cp.tracer.clear();
+		trace.saveState(cp.tracer);
+		if (keeper) {
+			cp.tapes.resize(views.size());
+			for (size_t i = 0; i < views.size(); i++)
+				cp.tapes[i].assign(views[i].cells, views[i].cells + views[i].len);
+			keeper(cp);
+		}
+		else
+			writeCheckpoint(filename, cp, views);
+		next = chrono::steady_clock::now() + interval();
+		next_step = steps + step_interval;
+	}
+
+private:
+	chrono::steady_clock::duration interval() const {
+		return chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(cp.every));
+	}
+
+	string filename;
+	Checkpoint cp;
+	FileTraceSink *sink;
+	Tracer &trace;
+	vector<function<TapeView()> > tapes;
+	vector<vector<TapeIdx *> > frames;
+	const Checkpoint *resume;
+	size_t resume_frame;
+	int countdown;
+	chrono::steady_clock::time_point next;
+	unsigned long long step_interval;
+	unsigned long long next_step;
+	unsigned long long stop_at;
+	function<void(const Checkpoint &)> keeper;
+};
+
+#ifdef TMSIM_PROFILE
+/* Counts where a native simulation spends its steps and time, when built with
+ * -DTMSIM_PROFILE (make profile). Machines report each state they move to
+ * with PROFILE_STATE, and everything up to the next one is put down to that
+ * state. A machine run as a black box inside another (add in mult, mult in
+ * exp) counts towards the state that runs it as well as its own states, which
+ * are listed under that state's name: AddOneY in the adds that exp does through
+ * mult is under exp, then Mult*, then Add*.
+ */
+class Profiler {
+public:
+	Profiler() : root("") {}
+
+	//a machine starts running, in the state it is in for its caller
+	void enter(const char *machine, unsigned long long steps) {
+		Stat *parent = stack.empty() ? root.child(machine) : stack.back().state ? stack.back().state : stack.back().machine;
+		Frame frame = {parent, nullptr, steps, now()};
+		stack.push_back(frame);
+	}
+	void leave(unsigned long long steps) {
+		state(nullptr, steps);
+		stack.pop_back();
+	}
+	//the current machine has moved to a new state (or stopped, if name is null)
+	void state(const char *name, unsigned long long steps) {
+		Frame &frame = stack.back();
+		chrono::steady_clock::time_point t = now();
+		if (frame.state) {
+			unsigned long long n = steps - frame.steps;
+			frame.state->visits++;
+			frame.state->steps += n;
+			frame.state->seconds += chrono::duration<double>(t - frame.start).count();
+			unsigned bucket = n ? 64 - __builtin_clzll(n) : 0;
+			if (frame.state->travel.size() <= bucket)
+				frame.state->travel.resize(bucket + 1);
+			frame.state->travel[bucket]++;
+		}
+		frame.state = name ? frame.machine->child(name) : nullptr;
+		frame.steps = steps;
+		frame.start = t;
+		for (size_t i = 0; i < tapes.size(); i++)
+			tapes[i].max_cells = max(tapes[i].max_cells, tapes[i].size());
+	}
+
+	//keep track of the most cells a tape ever has
+	template <class Tape>
+	void watchTape(const char *name, const Tape &tape) {
+		TapeMark mark = {name, [&tape]() -> size_t { return tape.size(); }, 0};
+		tapes.push_back(mark);
+	}
+
+	//time spent in a part of the code that isn't a state, such as writing the trace
+	void section(const char *name, double seconds) {
+		Section &s = sections[name];
+		s.calls++;
+		s.seconds += seconds;
+	}
+
+	static chrono::steady_clock::time_point now() {
+		return chrono::steady_clock::now();
+	}
+
+	//the counts so far as JSON, with the run described by the fields in header
+	string json(const string &header) const {
+		string out = "{\n" + header + "\t\"states\": [";
+		bool first = true;
+		jsonStates(root, "", out, first);
+		out += "\n\t],\n\t\"sections\": [";
+		for (map<string, Section>::const_iterator it = sections.begin(); it != sections.end(); ++it) {
+			out += string(it == sections.begin() ? "" : ",") + "\n\t\t{\"name\": \"" + it->first + "\", \"calls\": "
+				+ to_string(it->second.calls) + ", \"seconds\": " + jsonDouble(it->second.seconds) + "}";
+		}
+		out += "\n\t],\n\t\"tapes\": [";
+		for (size_t i = 0; i < tapes.size(); i++) {
+			out += string(i ? "," : "") + "\n\t\t{\"tape\": \"" + tapes[i].name + "\", \"max_cells\": "
+				+ to_string(tapes[i].max_cells) + "}";
+		}
+		return out + "\n\t]\n}\n";
+	}
+
+private:
+	struct Stat {
+		explicit Stat(const char *name) : name(name), visits(0), steps(0), seconds(0) {}
+		Stat *child(const char *name) {
+			//names are string literals, so the same one is almost always at the same address
+			for (size_t i = 0; i < children.size(); i++)
+				if (children[i]->name == name || strcmp(children[i]->name, name) == 0)
+					return children[i].get();
+			children.push_back(unique_ptr<Stat>(new Stat(name)));
+			return children.back().get();
+		}
+		const char *name;
+		unsigned long long visits;
+		unsigned long long steps;
+		double seconds;
+		//visits by the number of steps taken in them, which is how far the heads moved: bucket i counts visits of
+		//2^(i-1) up to 2^i - 1 steps
+		vector<unsigned long long> travel;
+		vector<unique_ptr<Stat> > children;
+	};
+	struct Frame {
+		//where the machine's states go
+		Stat *machine;
+		Stat *state;
+		unsigned long long steps;
+		chrono::steady_clock::time_point start;
+	};
+	struct TapeMark {
+		const char *name;
+		function<size_t()> size;
+		size_t max_cells;
+	};
+	struct Section {
+		Section() : calls(0), seconds(0) {}
+		unsigned long long calls;
+		double seconds;
+	};
+
+	static string jsonDouble(double v) {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.6g", v);
+		return buf;
+	}
+
+	void jsonStates(const Stat &stat, const string &path, string &out, bool &first) const {
+		for (size_t i = 0; i < stat.children.size(); i++) {
+			const Stat &s = *stat.children[i];
+			string name = path + s.name;
+			if (s.visits) {
+				out += string(first ? "" : ",") + "\n\t\t{\"state\": \"" + name + "\", \"visits\": " + to_string(s.visits)
+					+ ", \"steps\": " + to_string(s.steps) + ", \"seconds\": " + jsonDouble(s.seconds) + ", \"travel\": [";
+				for (size_t b = 0; b < s.travel.size(); b++)
+					out += (b ? ", " : "") + to_string(s.travel[b]);
+				out += "]}";
+				first = false;
+			}
+			jsonStates(s, name + "/", out, first);
+		}
+	}
+
+	Stat root;
+	vector<Frame> stack;
+	vector<TapeMark> tapes;
+	map<string, Section> sections;
+};
+
+//times everything the tracer it wraps does, since formatting the trace can take longer than the steps it records
+class ProfiledTracer : public Tracer {
+public:
+	ProfiledTracer(Tracer &inner, Profiler &profile) : inner(inner), profile(profile) {}
+	void text(const string &str) {
+		chrono::steady_clock::time_point start = Profiler::now();
+		inner.text(str);
+		done(start);
+	}
+	void start(const char *state, TapeIdx idx) {
+		chrono::steady_clock::time_point begin = Profiler::now();
+		inner.start(state, idx);
+		done(begin);
+	}
+	void step(const char *state, TapeIdx idx, TapeView tape) {
+		chrono::steady_clock::time_point start = Profiler::now();
+		inner.step(state, idx, tape);
+		done(start);
+	}
+	void halt(TapeIdx idx, TapeView tape) {
+		chrono::steady_clock::time_point start = Profiler::now();
+		inner.halt(idx, tape);
+		done(start);
+	}
+	void config(const char *state, const TracedTape *tapes, int count, bool initial) {
+		chrono::steady_clock::time_point start = Profiler::now();
+		inner.config(state, tapes, count, initial);
+		done(start);
+	}
+	void saveState(string &out) const {
+		inner.saveState(out);
+	}
+	void loadState(DeltaReader &in) {
+		inner.loadState(in);
+	}
+private:
+	void done(chrono::steady_clock::time_point start) {
+		profile.section("trace", chrono::duration<double>(Profiler::now() - start).count());
+	}
+
+	Tracer &inner;
+	Profiler &profile;
+};
+#endif
+
+//what a simulation keeps track of besides its tapes
+struct SimContext {
+	//TM steps taken so far
+	unsigned long long steps;
+	//whether runs of the scanning states are done with one search rather than a step at a time
+	bool accelerate;
+	//where black box runs of add and mult are looked up before they are simulated, if anywhere
+	ResultCache *cache;
+	//takes checkpoints of the simulation, if it has any
+	Checkpointer *checkpoint;
+	//whether add only traces the steps where it moves to another state, instead of every step
+	bool trace_transitions;
+	//whether runs of add and mult as the black box states Add* and Mult* are traced (see NestedTracer)
+	bool trace_nested;
+	//whether untraced runs of add and mult have their tapes and steps worked out from their inputs (see analyticAdd())
+	bool analytic;
+#ifdef TMSIM_PROFILE
+	Profiler *profile;
+	SimContext() : steps(0), accelerate(true), cache(nullptr), checkpoint(nullptr), trace_transitions(false), trace_nested(false),
+		analytic(false), profile(nullptr) {}
+#else
+	SimContext() : steps(0), accelerate(true), cache(nullptr), checkpoint(nullptr), trace_transitions(false), trace_nested(false),
+		analytic(false) {}
+#endif
+};
+
+//registers the heads a machine loop keeps in local variables with a checkpointer (if not null) while the loop runs
+class CheckpointFrame {
+public:
+	CheckpointFrame(Checkpointer *checkpoint, TapeIdx *head, TapeIdx *head2 = nullptr) : checkpoint(checkpoint), was_resumed(false) {
+		if (!checkpoint)
+			return;
+		vector<TapeIdx *> heads(1, head);
+		if (head2)
+			heads.push_back(head2);
+		was_resumed = checkpoint->enter(heads);
+	}
+	~CheckpointFrame() {
+		if (checkpoint)
+			checkpoint->leave();
+	}
+	//whether the heads were set from the checkpoint being resumed
+	bool resumed() const {
+		return was_resumed;
+	}
+private:
+	Checkpointer *checkpoint;
+	bool was_resumed;
+};
+
+//whether a simulation starts from a checkpoint rather than its inputs
+bool resuming(const SimContext &ctx) {
+	return ctx.checkpoint && ctx.checkpoint->resuming();
+}
+
+//include a tape of a simulation in its checkpoints, if it takes any
+template <class Tape>
+void attachTape(SimContext &ctx, Tape &tape) {
+	if (ctx.checkpoint)
+		ctx.checkpoint->attach(tape);
+}
+
+//called at the top of a machine loop, where a checkpoint can be taken
+void checkpointIfDue(SimContext &ctx) {
+	if (ctx.checkpoint && ctx.checkpoint->due(ctx.steps))
+		ctx.checkpoint->save(ctx.steps);
+}
+
+#ifdef TMSIM_PROFILE
+//reports a machine to ctx's profiler for as long as it runs
+class ProfileMachine {
+public:
+	ProfileMachine(SimContext &ctx, const char *name) : ctx(ctx) {
+		if (ctx.profile)
+			ctx.profile->enter(name, ctx.steps);
+	}
+	~ProfileMachine() {
+		if (ctx.profile)
+			ctx.profile->leave(ctx.steps);
+	}
+private:
+	SimContext &ctx;
+};
+
+//times a section of code for ctx's profiler
+class ProfileSection {
+public:
+	ProfileSection(SimContext &ctx, const char *name) : ctx(ctx), name(name), start(Profiler::now()) {}
+	~ProfileSection() {
+		if (ctx.profile)
+			ctx.profile->section(name, chrono::duration<double>(Profiler::now() - start).count());
+	}
+private:
+	SimContext &ctx;
+	const char *name;
+	chrono::steady_clock::time_point start;
+};
+
+#define PROFILE_MACHINE(ctx, name) ProfileMachine profile_machine(ctx, name)
+#define PROFILE_STATE(ctx, name) do { if ((ctx).profile) (ctx).profile->state(name, (ctx).steps); } while (0)
+#define PROFILE_SECTION(ctx, name) ProfileSection profile_section(ctx, name)
+#define PROFILE_TAPE(ctx, name, tape) do { if ((ctx).profile) (ctx).profile->watchTape(name, tape); } while (0)
+#else
+//without TMSIM_PROFILE these compile to nothing
+#define PROFILE_MACHINE(ctx, name)
+#define PROFILE_STATE(ctx, name) do {} while (0)
+#define PROFILE_SECTION(ctx, name)
+#define PROFILE_TAPE(ctx, name, tape) do {} while (0)
+#endif
+
+/* The functions below that return tape indices are representative of states in the
+ * simulated Turing machine. A negative return value indicates a transition
+ * to some other state to the caller, and all return values represent the next
+ * cell to move to on the tape by its index (or the negative of its index)
+ */
+
+//decrement the first input x by 1
+template <class Tape>
+TapeIdx takeOneX(Tape &tape, TapeIdx idx) {
+	if (tape[idx] == '0') {
+		tape[idx] = '1';
+		return idx + 1;
+	}
+	if (tape[idx] == '1') {
+		tape[idx] = '0';
+	}
+	return -idx;
+}
+
+//currently in the first input's cells, keep going until reaching a blank
+template <class Tape>
+TapeIdx addOneX(Tape &tape, TapeIdx idx) {
+	if (tape[idx] == 'B')
+		return -idx - 1;
+	return idx + 1;
+}
+
+//add 1 to the integer represented in the cells that originally hold the second input y
+template <class Tape>
+TapeIdx addOneY(Tape &tape, TapeIdx idx) {
+	if (tape[idx] == '1') {
+		tape[idx] = '0';
+		return idx + 1;
+	}
+	if (tape[idx] == '0') {
+		tape[idx] = '1';
+		return -idx + 1;
+	}
+	//Blank case - expand the vector that represents the tape
+	tape[idx] = '1';
+	writeSafe(tape, 'B', idx+1);
+	return -idx + 1;
+}
+
+//go left until a blank, then go left once more and transition
+template <class Tape>
+TapeIdx getNextY(Tape &tape, TapeIdx idx) {
+	if (tape[idx] == 'B')
+		return -idx + 1;
+	return idx - 1;
+}
+
+//go left until a blank, then go right one time and transition
+template <class Tape>
+TapeIdx getNextX(Tape &tape, TapeIdx idx) {
+	if (tape[idx] == 'B')
+		return -idx - 1;
+	return idx - 1;
+}
+
+/* The scanning states only move the head until they read a blank. When
+ * scans are accelerated a whole run of one is done with a single search, and
+ * the steps it would have taken are added to the count, so either way these
+ * leave the head and step count where the state's loop would have.
+ */
+
+//addOneX: right up to the next blank, then one more cell right
+template <class Tape>
+void runAddOneX(Tape &tape, TapeIdx &idx, SimContext &ctx) {
+	if (!ctx.accelerate) {
+		while (idx > 0) {
+			idx = addOneX(tape, idx);
+			ctx.steps++;
+		}
+		idx = -idx;
+		return;
+	}
+	TapeIdx blank = blankRight(tape, idx);
+	ctx.steps += blank - idx + 1;
+	idx = blank + 1;
+}
+
+//getNextY: left up to the next blank, then one more cell left
+template <class Tape>
+void runGetNextY(Tape &tape, TapeIdx &idx, SimContext &ctx) {
+	if (!ctx.accelerate) {
+		while (idx > 0) {
+			idx = getNextY(tape, idx);
+			ctx.steps++;
+		}
+		idx = -idx;
+		return;
+	}
+	TapeIdx blank = blankLeft(tape, idx);
+	ctx.steps += idx - blank + 1;
+	idx = blank - 1;
+}
+
+//getNextX: left up to the next blank, then back right one cell
+template <class Tape>
+void runGetNextX(Tape &tape, TapeIdx &idx, SimContext &ctx) {
+	if (!ctx.accelerate) {
+		while (idx >= 0) {
+			idx = getNextX(tape, idx);
+			ctx.steps++;
+		}
+		idx = -idx;
+		return;
+	}
+	TapeIdx blank = blankLeft(tape, idx);
+	ctx.steps += idx - blank + 1;
+	idx = blank + 1;
+}
+
+/* given a pre-formed input tape, perform an addition and return the index of
+ * the blank ('B') char that precedes the output. A detailed add traces every
+ * step, or with ctx.trace_transitions only the first step in each state it
+ * moves to; an add run as Add* only traces those, and only with ctx.trace_nested.
+ */
+template <class Tape>
+TapeIdx addSim(Tape &tape, Tracer &trace, SimContext &ctx, bool detailed=true) {
+	TapeIdx cur_idx = 1;
+	//an add inside mult runs from start to end within one step of mult, so only a top level one takes checkpoints
+	CheckpointFrame frame(detailed ? ctx.checkpoint : nullptr, &cur_idx);
+	PROFILE_MACHINE(ctx, "add");
+	bool every_step = detailed && !ctx.trace_transitions;
+	bool transitions = !every_step && (detailed || ctx.trace_nested);
+
+	while (1) {
+		if (detailed)
+			checkpointIfDue(ctx);
+		//subtract 1 from x by traversing it from the left and changing bit values
+		PROFILE_STATE(ctx, "TakeOneX");
+		if (transitions)
+			trace.step("TakeOneX", cur_idx, view(tape));
+		while (cur_idx > 0) {
+			if (every_step)
+				trace.step("TakeOneX", cur_idx, view(tape));
+			cur_idx = takeOneX(tape, cur_idx);
+			ctx.steps++;
+		}
+		cur_idx = -cur_idx;
+		
+		//Addition is finished in this case, since ending at a blank means all bits in place of the input are now 0
+		if (tape[cur_idx] == 'B') {
+			//x was subtracted from itself and added to the section of tape cells that contained y
+			if (detailed) {
+				trace.halt(cur_idx, view(tape));
+				eraseFront(tape, cur_idx);
+			}
+			return cur_idx;
+		}
+		
+		//get to the single blank cell that separated the 2 inputs, then go right once to y
+		PROFILE_STATE(ctx, "AddOneX");
+		if (every_step) {
+			while (cur_idx > 0) {
+				trace.step("AddOneX", cur_idx, view(tape));
+				cur_idx = addOneX(tape, cur_idx);
+				ctx.steps++;
+			}
+			cur_idx = -cur_idx;
+		}
+		else {
+			if (transitions)
+				trace.step("AddOneX", cur_idx, view(tape));
+			runAddOneX(tape, cur_idx, ctx);
+		}
+		
+		//add the one subtracted from x to y
+		PROFILE_STATE(ctx, "AddOneY");
+		if (transitions)
+			trace.step("AddOneY", cur_idx, view(tape));
+		while (cur_idx > 0) {
+			if (every_step)
+				trace.step("AddOneY", cur_idx, view(tape));
+			cur_idx = addOneY(tape, cur_idx);
+			ctx.steps++;
+		}
+		cur_idx = -cur_idx;
+		
+		//now go back to the separating blank and then left one more time to reach the x cells
+		PROFILE_STATE(ctx, "GetNextY");
+		if (every_step) {
+			while (cur_idx > 0) {
+				trace.step("GetNextY", cur_idx, view(tape));
+				cur_idx = getNextY(tape, cur_idx);
+				ctx.steps++;
+			}
+			cur_idx = -cur_idx;
+		}
+		else {
+			if (transitions)
+				trace.step("GetNextY", cur_idx, view(tape));
+			runGetNextY(tape, cur_idx, ctx);
+		}
+		
+		//go to the first cell for x to start the next iteration
+		PROFILE_STATE(ctx, "GetNextX");
+		if (every_step) {
+			while (cur_idx >= 0) {
+				trace.step("GetNextX", cur_idx, view(tape));
+				cur_idx = getNextX(tape, cur_idx);
+				ctx.steps++;
+			}
+			cur_idx = -cur_idx;
+		}
+		else {
+			if (transitions)
+				trace.step("GetNextX", cur_idx, view(tape));
+			runGetNextX(tape, cur_idx, ctx);
+		}
+	}
+}
+
+//append cells from through to of a tape to str
+void appendCells(const vector<char> &tape, TapeIdx from, TapeIdx to, string &str) {
+	str.append(tape.data() + from, to - from + 1);
+}
+
+void appendCells(const PackedTape &tape, TapeIdx from, TapeIdx to, string &str) {
+	for (TapeIdx i = from; i <= to; i++)
+		str += tape[i];
+}
+
+void appendCells(const MappedTape &tape, TapeIdx from, TapeIdx to, string &str) {
+	str.append(tape.data() + from, to - from + 1);
+}
+
+void appendCells(const OriginTape &tape, TapeIdx from, TapeIdx to, string &str) {
+	str.append(tape.data() + from, to - from + 1);
+}
+
+//overwrite the first cells of a tape with the given ones
+template <class Tape>
+void putCells(Tape &tape, const string &cells) {
+	if (tape.size() < cells.size())
+		tape.resize(cells.size(), 'B');
+	for (size_t i = 0; i < cells.size(); i++)
+		tape[i] = cells[i];
+}
+
+//the blank that ends the given number of inputs, the first of which starts at cell 1
+template <class Tape>
+TapeIdx inputsEnd(const Tape &tape, int inputs) {
+	TapeIdx idx = 0;
+	for (int i = 0; i < inputs; i++)
+		idx = blankRight(tape, idx + 1);
+	return min(idx, (TapeIdx)tape.size() - 1);
+}
+
+//the number written LSB first in cells from through to of a tape, or false if it doesn't fit in 64 bits
+template <class Tape>
+bool cellsValue(const Tape &tape, TapeIdx from, TapeIdx to, unsigned long long &value) {
+	value = 0;
+	for (TapeIdx i = to; i >= from; i--) {
+		if (value >> 63)
+			return false;
+		value = value << 1 | (tape[i] == '1');
+	}
+	return true;
+}
+
+//write value LSB first over cells cells of a tape from from on, followed by a blank
+template <class Tape>
+void putValue(Tape &tape, TapeIdx from, TapeIdx cells, unsigned long long value) {
+	for (TapeIdx i = 0; i < cells; i++, value >>= 1)
+		writeSafe(tape, value & 1 ? '1' : '0', from + i);
+	writeSafe(tape, 'B', from + cells);
+}
+
+//what analyticAdd() and analyticMult() give when the step count doesn't fit in ctx.steps
+const char STEPS_OVERFLOW[] = "The step count goes past 2^64";
+
+//sum += a * b, or false if that would go past 64 bits
+bool addProduct(unsigned long long &sum, unsigned long long a, unsigned long long b) {
+	unsigned long long product;
+	return !__builtin_mul_overflow(a, b, &product) && !__builtin_add_overflow(sum, product, &sum);
+}
+
+/* do what an untraced addSim does to a tape of the form BxByB without stepping through it, and add the steps it would
+ * have taken to ctx.steps. Each time round, TakeOneX takes t + 1 steps over the t trailing 0s of x, AddOneX the
+ * other Lx - t (Lx is the number of cells of x), AddOneY one more than the trailing 1s of y, and GetNextY and
+ * GetNextX 1 + Ly + 1 + Lx between them, which comes to 2Lx + 5 + 2(trailing 1s of y) whatever x is. Adding 1 to y
+ * turns its trailing 1s to 0s and sets one 0, so over the X rounds the trailing 1s of y add up to
+ * X + popcount(Y) - popcount(X + Y). The last TakeOneX turns the Lx 0s of x to 1s and reads the blank, so:
+ *
+ *   steps = X(2Lx + 7) + 2(popcount(Y) - popcount(X + Y)) + Lx + 1
+ *
+ * y can be any length. A step count past 64 bits is an error, as simulating it couldn't count it either, and an X
+ * that doesn't fit in 64 bits always gives one, as the steps are at least X(2Lx + 7). Otherwise head is set to the
+ * blank before the sum, where addSim halts.
+ */
+template <class Tape>
+void analyticAdd(Tape &tape, TapeIdx &head, SimContext &ctx) {
+	TapeIdx x_end = blankRight(tape, 1);
+	TapeIdx y_end = blankRight(tape, x_end + 1);
+	unsigned long long x;
+	if (!cellsValue(tape, 1, x_end - 1, x))
+		throw runtime_error(STEPS_OVERFLOW);
+	//add x to y a bit at a time, carrying the rest of x along
+	unsigned long long carry = x;
+	unsigned long long pop_y = 0, pop_sum = 0;
+	TapeIdx sum_cells = 0;
+	for (TapeIdx i = x_end + 1; i < y_end || carry; i++, sum_cells++) {
+		unsigned bit = i < y_end && tape[i] == '1';
+		unsigned total = (carry & 1) + bit;
+		pop_y += bit;
+		pop_sum += total & 1;
+		carry = (carry >> 1) + (total >> 1);
+	}
+	unsigned long long lx = x_end - 1;
+	unsigned long long steps = lx + 1 + 2 * pop_y;
+	if (!addProduct(steps, x, 2 * lx + 7) || __builtin_add_overflow(ctx.steps, steps - 2 * pop_sum, &steps))
+		throw runtime_error(STEPS_OVERFLOW);
+	ctx.steps = steps;
+
+	carry = x;
+	for (TapeIdx i = x_end + 1; i < x_end + 1 + sum_cells; i++) {
+		unsigned total = (carry & 1) + (i < y_end && tape[i] == '1');
+		writeSafe(tape, total & 1 ? '1' : '0', i);
+		carry = (carry >> 1) + (total >> 1);
+	}
+	//the sum only gets a blank written after it if it grew
+	if (x_end + 1 + sum_cells > y_end)
+		writeSafe(tape, 'B', x_end + 1 + sum_cells);
+	for (TapeIdx i = 1; i < x_end; i++)
+		tape[i] = '1';
+	head = x_end;
+}
+
+//addSim without a trace, replayed from ctx.cache if it has been run from the same cells before
+template <class Tape>
+TapeIdx cachedAddSim(Tape &tape, Tracer &trace, SimContext &ctx) {
+	TapeIdx head;
+	if (ctx.analytic) {
+		analyticAdd(tape, head, ctx);
+		return head;
+	}
+	if (!ctx.cache)
+		return addSim(tape, trace, ctx, false);
+	TapeIdx end = inputsEnd(tape, 2);
+	string key = "+";
+	appendCells(tape, 0, end, key);
+	ResultCache::Result res;
+	if (ctx.cache->find(key, res)) {
+		putCells(tape, res.cells);
+		ctx.steps += res.steps;
+		return res.head;
+	}
+	unsigned long long start = ctx.steps;
+	res.head = addSim(tape, trace, ctx, false);
+	res.steps = ctx.steps - start;
+	//the last cell written is the blank after the sum, which only ever grows right
+	appendCells(tape, 0, max(end, inputsEnd(tape, 2)), res.cells);
+	ctx.cache->insert(key, res);
+	return res.head;
+}
+
+//addSim as mult's Add* state, with its states in mult's trace (ctx.trace_nested)
+template <class Tape>
+TapeIdx nestedAddSim(Tape &add_tape, const Tape &mult_tape, TapeIdx mult_idx, Tracer &trace, SimContext &ctx) {
+	TracedTape outer = {"Mult", mult_idx, view(mult_tape)};
+	NestedTracer nested(trace, "Add*", "Add", &outer, 1);
+	return addSim(add_tape, nested, ctx, false);
+}
+
+//initialize a tape with 2 arguments x,y for add, with three blanks 
+template <class Tape>
+void initTape(const BigNum &x, const BigNum &y, Tape &tape) {
+	//Bx...By...B
+	vector<char> vec_x = binVector(x);
+	vector<char> vec_y = binVector(y);
+	tape.push_back('B');
+	for (size_t i = 0; i < vec_x.size(); i++)
+		tape.push_back(vec_x[i]);
+	tape.push_back('B');
+	for (size_t i = 0; i < vec_y.size(); i++)
+		tape.push_back(vec_y[i]);
+	tape.push_back('B');
+}
+
+/* the most cells a tape is made ready for up front. A machine whose numbers got longer than this would take far more
+ * steps than could ever be run, so past it the tape is left to grow by itself
+ */
+const size_t MAX_TAPE_HINT = (size_t)1 << 24;
+
+//the cells of a tape that holds the given count of numbers of up to bits bits, each with a blank after it
+size_t tapeHint(size_t bits, size_t numbers) {
+	return min(MAX_TAPE_HINT, (bits + 1) * numbers + 1);
+}
+
+//the cells x takes on a tape
+size_t bitCells(const BigNum &x) {
+	return max(x.bitLength(), (size_t)1);
+}
+
+//the most bits x^y can have, or MAX_TAPE_HINT if that is more
+size_t powCells(const BigNum &x, const BigNum &y) {
+	if (y.bitLength() > 32)
+		return MAX_TAPE_HINT;
+	unsigned long long y_value = 0;
+	for (size_t i = 0; i < y.bitLength(); i++)
+		y_value |= (unsigned long long)y.bit(i) << i;
+	return min((unsigned long long)MAX_TAPE_HINT, bitCells(x) * y_value + 1);
+}
+
+//perform an addition in a simulated TM given the int args
+template <class Tape = OriginTape>
+Tape add(const BigNum &x, const BigNum &y, Tracer &trace, SimContext &ctx) {
+	Tape tape;
+	attachTape(ctx, tape);
+	reserveTape(tape, tapeHint(max(bitCells(x), bitCells(y)) + 1, 2));
+	PROFILE_TAPE(ctx, "Add", tape);
+	if (!resuming(ctx)) {
+		initTape(x, y, tape);
+		trace.text("Trace for " + x.toString() + " + " + y.toString() + "\n\n");
+		trace.start("Start", 0);
+		//the start state moves onto the first bit of x
+		ctx.steps++;
+	}
+	//with nothing to trace, the whole add can be worked out at once, ending where a traced one would
+	TapeIdx head;
+	if (ctx.analytic) {
+		analyticAdd(tape, head, ctx);
+		eraseFront(tape, head);
+	}
+	else
+		addSim(tape, trace, ctx);
+	return tape;
+}
+
+vector<char> add(const BigNum &x, const BigNum &y, string &trace) {
+	StringTraceSink sink(trace);
+	TextTracer text_trace(sink);
+	SimContext ctx;
+	trace.clear();
+	return cells(add(x, y, text_trace, ctx));
+}
+
+//given a tape of the form BxB, where x is the result, interpret it as a number
+BigNum interpretTapeRes(TapeView tape) {
+	return BigNum::fromBits(tape.cells + 1, tape.len - 2);
+}
+
+//record the configuration at one step in the exponentiation TM simulation
+template <class Tape>
+void traceStepExp(Tracer &trace, const char *state_name, TapeIdx mult_idx, TapeIdx exp_idx, const Tape &exp_tape, const Tape &mult_tape, bool initial=false) {
+	TracedTape tapes[2] = {{"Mult", mult_idx, view(mult_tape)}, {"Exp", exp_idx, view(exp_tape)}};
+	trace.config(state_name, tapes, 2, initial);
+}
+
+/* copy chars from read tape to write tape in order from the given indices in
+ * each, up to and including the next blank (left to right)
+ */
+template <class Tape>
+void copyUntilBlank(Tape &tape_read, Tape &tape_write, TapeIdx &idx_r, TapeIdx &idx_w, SimContext &ctx) {
+	PROFILE_SECTION(ctx, "copyUntilBlank");
+	TapeIdx len = blankRight(tape_read, idx_r) - idx_r;
+	writeSafe(tape_write, 'B', idx_w + len);
+	copyCells(tape_read, idx_r, len, tape_write, idx_w);
+	//a step for each cell copied and one for the blank
+	ctx.steps += len + 1;
+	idx_r += len - 1;
+	idx_w += len - 1;
+}
+
+/* for add tape, moves from the last char before the last blank to the first
+ * char after the first blank
+ */
+template <class Tape>
+void moveToInputStart(Tape &tape, TapeIdx &idx, SimContext &ctx) {
+	runGetNextY(tape, idx, ctx);
+	runGetNextX(tape, idx, ctx);
+}
+
+//see moveToInputStart (this tape stores 3 blank-separated values instead of 2)
+template <class Tape>
+void moveToMultStart(Tape &tape, TapeIdx &idx, SimContext &ctx) {
+	runGetNextY(tape, idx, ctx);
+	runGetNextY(tape, idx, ctx);
+	runGetNextX(tape, idx, ctx);
+}
+
+//record the configuration of the multiplication TM at the current state in the trace
+template <class Tape>
+void traceStep(Tracer &trace, const char *state_name, TapeIdx add_idx, TapeIdx mult_idx, const Tape &mult_tape, const Tape &add_tape, bool initial=false) {
+	TracedTape tapes[2] = {{"Add", add_idx, view(add_tape)}, {"Mult", mult_idx, view(mult_tape)}};
+	trace.config(state_name, tapes, 2, initial);
+}
+
+//simulate a multiplication on a given mult tape and a blank add tape
+template <class Tape>
+TapeIdx multSim(Tape &add_tape, Tape &tape, Tracer &trace, SimContext &ctx, bool detailed = true) {
+	//move to the second cell after the blank in each tape to start
+	TapeIdx mult_idx = 1;
+	TapeIdx add_idx = 1;
+	CheckpointFrame frame(ctx.checkpoint, &mult_idx, &add_idx);
+	PROFILE_MACHINE(ctx, "mult");
+	//a mult run as Mult* is only traced with ctx.trace_nested, and only a top level one shows its halt
+	bool traced = detailed || ctx.trace_nested;
+	//multiply by repeated addition of x copies of y
+	while (1) {
+		checkpointIfDue(ctx);
+		//decrement x by 1
+		PROFILE_STATE(ctx, "TakeOneInX");
+		if (traced) {
+			traceStep(trace, "TakeOneInX", add_idx, mult_idx, tape, add_tape);
+		}
+		while (mult_idx > 0) {
+			mult_idx = takeOneX(tape, mult_idx);
+			ctx.steps++;
+		}
+		mult_idx = -mult_idx;
+		if (tape[mult_idx] == 'B') {
+			// when x=0 on the mult tape, the multiplication is finished
+			//TakeOneInX moves right when the current cell has a blank and transitions
+			mult_idx++;
+			PROFILE_STATE(ctx, "MoveToOutputFromY");
+			if (traced)
+				traceStep(trace, "MoveToOutputFromY", add_idx, mult_idx, tape, add_tape);
+			//position tape head at blank right before first bit of output (unlike addOneX, it stays on the blank)
+			runAddOneX(tape, mult_idx, ctx);
+			mult_idx--;
+			if (detailed) {
+				traceStep(trace, "Halt", add_idx, mult_idx, tape, add_tape);
+				eraseFront(tape, mult_idx);
+			}
+			//return index of first cell of output
+			return mult_idx+1;
+		}
+		PROFILE_STATE(ctx, "MoveToYFromX");
+		if (traced)
+			traceStep(trace, "MoveToYFromX", add_idx, mult_idx, tape, add_tape);
+		//move to the separator blank between x and y, then move right one last time
+		//so the mult tape head is at first bit of y
+		runAddOneX(tape, mult_idx, ctx);
+		PROFILE_STATE(ctx, "WriteFirstAddArg");
+		if (traced)
+			traceStep(trace, "WriteFirstAddArg", add_idx, mult_idx, tape, add_tape);
+		//write y from the mult tape in the first arg position in the add tape
+		copyUntilBlank(tape, add_tape, mult_idx, add_idx, ctx);
+		//want the tape heads to be on the right side of their respective blanks
+		mult_idx += 2;
+		add_idx += 2;
+		PROFILE_STATE(ctx, "WriteSecondAddArg");
+		if (traced)
+			traceStep(trace, "WriteSecondAddArg", add_idx, mult_idx, tape, add_tape);
+		//make the result so far from the mult tape the second arg on the add tape
+		copyUntilBlank(tape, add_tape, mult_idx, add_idx, ctx);
+
+		PROFILE_STATE(ctx, "MoveToBeginAdd");
+		if (traced)
+			traceStep(trace, "MoveToBeginAdd", add_idx, mult_idx, tape, add_tape);
+		//send tape head in add tape to first bit of its first input after copying result
+		moveToInputStart(add_tape, add_idx, ctx);
+
+		PROFILE_STATE(ctx, "Add*");
+		if (traced)
+			traceStep(trace, "Add*", add_idx, mult_idx, tape, add_tape);
+		//compute the sum whose input args are on the add tape, and increment position to first bit of answer sum
+		add_idx = (ctx.trace_nested ? nestedAddSim(add_tape, tape, mult_idx, trace, ctx) : cachedAddSim(add_tape, trace, ctx)) + 1;
+
+		PROFILE_STATE(ctx, "MoveToOutputStartFromEnd");
+		if (traced)
+			traceStep(trace, "MoveToOutputStartFromEnd", add_idx, mult_idx, tape, add_tape);
+		//position mult tape head at the first cell of where the result goes from the end cell,
+		//the first bit of old result
+		runGetNextX(tape, mult_idx, ctx);
+
+		PROFILE_STATE(ctx, "WriteSumBack");
+		if (traced)
+			traceStep(trace, "WriteSumBack", add_idx, mult_idx, tape, add_tape);
+		//write new sum from the add tape over old one on the mult tape
+		copyUntilBlank(add_tape, tape, add_idx, mult_idx, ctx);
+
+		PROFILE_STATE(ctx, "FirstCellFromEndAddTape*");
+		if (traced)
+			traceStep(trace, "FirstCellFromEndAddTape*", add_idx, mult_idx, tape, add_tape);
+		//move tape heads back to initial positions for beginning of next iteration
+		moveToInputStart(add_tape, add_idx, ctx);
+		PROFILE_STATE(ctx, "FirstCellFromEndMultTape*");
+		if (traced)
+			traceStep(trace, "FirstCellFromEndMultTape*", add_idx, mult_idx, tape, add_tape);
+		moveToMultStart(tape, mult_idx, ctx);
+	}
+}
+
+//multiply 2 input ints x and y by inputting them to a simulated 2-tape TM
+template <class Tape = OriginTape>
+Tape mult(const BigNum &x, const BigNum &y, Tracer &trace, SimContext &ctx, bool detailed=true) {
+	Tape tape;
+	Tape add_tape;
+	attachTape(ctx, tape);
+	attachTape(ctx, add_tape);
+	//the product has at most as many bits as x and y together
+	size_t product_bits = bitCells(x) + bitCells(y);
+	reserveTape(tape, tapeHint(product_bits, 3));
+	reserveTape(add_tape, tapeHint(product_bits, 2));
+	PROFILE_TAPE(ctx, "Mult", tape);
+	PROFILE_TAPE(ctx, "Add", add_tape);
+	if (!resuming(ctx)) {
+		initTape(x, y, tape);
+		//add another value to the mult tape representing the output (0 for now)
+		tape.push_back('0');
+		tape.push_back('B');
+		if (detailed)
+			trace.text("Abbreviated Trace for " + x.toString() + " x " + y.toString() + "\n\n");
+
+		//add tape initially blank
+		add_tape.push_back('B');
+		if (detailed)
+			traceStep(trace, "Start", 0, 0, tape, add_tape, true);
+
+		//the start state moves both heads right
+		ctx.steps++;
+	}
+	//as with add, an untraced mult can be worked out at once, halting where multSim would
+	TapeIdx head;
+	if (ctx.analytic && analyticMult(add_tape, tape, head, ctx)) {
+		if (detailed)
+			eraseFront(tape, head - 1);
+	}
+	else
+		multSim(add_tape, tape, trace, ctx, detailed);
+	return tape;
+}
+
+vector<char> mult(const BigNum &x, const BigNum &y, string &trace, bool detailed=true) {
+	StringTraceSink sink(trace);
+	TextTracer text_trace(sink);
+	SimContext ctx;
+	trace.clear();
+	return cells(mult(x, y, text_trace, ctx, detailed));
+}
+
+/* do what an untraced multSim does to a mult tape of the form BxByBrB, where r is the result so far, and the add tape
+ * without stepping through it, and add the steps it would have taken to ctx.steps. Round i of the X rounds takes
+ * 2Lx + 4Ly + 3R(i) + 3R(i + 1) + 13 steps outside of Add* (the t + 1 of TakeOneInX and Lx + 1 - t of MoveToYFromX
+ * over the t trailing 0s of x add up to Lx + 2), where Lx and Ly are the numbers of cells of x and y and R(i) that of
+ * the result r + iY after i rounds, which is the larger of R(0) and its bit length. Add* then takes
+ * Y(2Ly + 7) + 2(popcount(r + iY) - popcount(r + (i + 1)Y)) + Ly + 1 (see analyticAdd()), and once x is 0 there are
+ * Lx + 1 + Ly + 1 more. The popcounts cancel out round to round, and the sum of the R(i) is worked out a bit length
+ * at a time, from how many of the results have at least that many bits.
+ *
+ * r and r + XY have to fit in 64 bits, or else the tapes are left alone and false returned so multSim can be run
+ * instead. As with analyticAdd() the step count has to fit too, and it can't if x isn't 0 and x, y or XY doesn't fit
+ * in 64 bits, as each of the X rounds takes at least Y(2Ly + 7) steps, so that is thrown at once rather than
+ * simulated. Otherwise head is set to the first cell of the product, which multSim returns.
+ */
+template <class Tape>
+bool analyticMult(Tape &add_tape, Tape &tape, TapeIdx &head, SimContext &ctx) {
+	TapeIdx x_end = blankRight(tape, 1);
+	TapeIdx y_end = blankRight(tape, x_end + 1);
+	TapeIdx r_end = blankRight(tape, y_end + 1);
+	unsigned long long x, y, r;
+	bool x_fits = cellsValue(tape, 1, x_end - 1, x);
+	//y is never added when x is 0, so it can be any length
+	if (x_fits && !x)
+		y = 0;
+	else if (!x_fits || !cellsValue(tape, x_end + 1, y_end - 1, y))
+		throw runtime_error(STEPS_OVERFLOW);
+	unsigned long long res = 0;
+	if (!addProduct(res, x, y))
+		throw runtime_error(STEPS_OVERFLOW);
+	if (!cellsValue(tape, y_end + 1, r_end - 1, r) || __builtin_add_overflow(res, r, &res))
+		return false;
+	unsigned long long lx = x_end - 1, ly = y_end - x_end - 1, r_cells = r_end - y_end - 1;
+	unsigned long long res_cells = max(r_cells, res ? 64ULL - __builtin_clzll(res) : 0ULL);
+
+	//the R(i) for i from 0 to X start at R(0) and go up by one at each power of 2 that r + iY reaches
+	unsigned long long cells_sum = 0;
+	bool fits = addProduct(cells_sum, x + 1, r_cells) && x + 1 != 0;
+	for (unsigned long long bits = r_cells + 1; bits <= res_cells; bits++) {
+		unsigned long long least = 1ULL << (bits - 1);
+		//the first round whose result has this many bits (y isn't 0, or res wouldn't be above r_cells bits)
+		unsigned long long first = least <= r ? 0 : (least - r - 1) / y + 1;
+		fits = fits && !__builtin_add_overflow(cells_sum, x - first + 1, &cells_sum);
+	}
+	unsigned long long round = 2 * lx + 5 * ly + 14;
+	unsigned long long steps = 2 * __builtin_popcountll(r) + lx + ly + 2;
+	fits = fits && addProduct(round, y, 2 * ly + 7) && addProduct(steps, x, round) && addProduct(steps, cells_sum, 6)
+		&& !__builtin_add_overflow(ctx.steps, steps - 3 * r_cells - 3 * res_cells - 2 * __builtin_popcountll(res), &steps);
+	if (!fits)
+		throw runtime_error(STEPS_OVERFLOW);
+	ctx.steps = steps;
+
+	for (TapeIdx i = 1; i < x_end; i++)
+		tape[i] = '1';
+	putValue(tape, y_end + 1, res_cells, res);
+	//the add tape is left with the last add: y turned to 1s and the product after it
+	if (x) {
+		for (TapeIdx i = 1; i <= (TapeIdx)ly; i++)
+			writeSafe(add_tape, '1', i);
+		writeSafe(add_tape, 'B', ly + 1);
+		putValue(add_tape, ly + 2, res_cells, res);
+	}
+	head = y_end + 1;
+	return true;
+}
+
+//multSim without a trace, replayed from ctx.cache if it has been run from the same cells before
+template <class Tape>
+TapeIdx cachedMultSim(Tape &add_tape, Tape &tape, Tracer &trace, SimContext &ctx) {
+	TapeIdx head;
+	if (ctx.analytic && analyticMult(add_tape, tape, head, ctx))
+		return head;
+	if (!ctx.cache)
+		return multSim(add_tape, tape, trace, ctx, false);
+	TapeIdx end = inputsEnd(tape, 3);
+	string key = "*";
+	appendCells(tape, 0, end, key);
+	ResultCache::Result res;
+	if (ctx.cache->find(key, res)) {
+		putCells(tape, res.cells);
+		putCells(add_tape, res.aux);
+		ctx.steps += res.steps;
+		return res.head;
+	}
+	//the add tape is only used if there is a 1 in x to take away
+	TapeIdx x_end = blankRight(tape, 1);
+	bool adds = find(key.begin() + 2, key.begin() + 1 + x_end, '1') != key.begin() + 1 + x_end;
+	unsigned long long start = ctx.steps;
+	res.head = multSim(add_tape, tape, trace, ctx, false);
+	res.steps = ctx.steps - start;
+	//the last cells written are the product, and on the add tape the last sum, which are the longest
+	appendCells(tape, 0, max(end, inputsEnd(tape, 3)), res.cells);
+	if (adds)
+		appendCells(add_tape, 0, inputsEnd(add_tape, 2), res.aux);
+	ctx.cache->insert(key, res);
+	return res.head;
+}
+
+//multSim as exp's Mult* state, with its states in exp's trace (ctx.trace_nested)
+template <class Tape>
+TapeIdx nestedMultSim(Tape &add_tape, Tape &mult_tape, const Tape &exp_tape, TapeIdx exp_idx, Tracer &trace, SimContext &ctx) {
+	TracedTape outer = {"Exp", exp_idx, view(exp_tape)};
+	NestedTracer nested(trace, "Mult*", "Mult", &outer, 1);
+	return multSim(add_tape, mult_tape, nested, ctx, false);
+}
+
+//simulate an exponentiation TM given input tapes
+template <class Tape>
+TapeIdx expSim(Tape &add_tape, Tape &mult_tape, Tape &tape, Tracer &trace, SimContext &ctx) {
+	TapeIdx mult_idx = 1;
+	TapeIdx exp_idx = 1;
+	//checkpoints are taken inside Mult*, which is where a resumed run picks up
+	CheckpointFrame frame(ctx.checkpoint, &exp_idx);
+	PROFILE_MACHINE(ctx, "exp");
+	bool in_mult = frame.resumed();
+
+	while (1) {
+		if (!in_mult) {
+			PROFILE_STATE(ctx, "MoveToYFromXForDecrement");
+			traceStepExp(trace, "MoveToYFromXForDecrement", mult_idx, exp_idx, tape, mult_tape);
+			//move from x's position on the exp tape to y's leftmost cell so that it can be decremented
+			runAddOneX(tape, exp_idx, ctx);
+
+			//decrement y
+			PROFILE_STATE(ctx, "DecrementY");
+			traceStepExp(trace, "DecrementY", mult_idx, exp_idx, tape, mult_tape);
+			while (exp_idx > 0) {
+				exp_idx = takeOneX(tape, exp_idx);
+				ctx.steps++;
+			}
+		
+			//tape is at position of the tape where a 1 was changed to a 0, or a blank if there wasn't one in y
+			exp_idx = -exp_idx;
+		
+
+			//if a blank was reached in DecrementY, then the result cells have the final output
+			if (tape[exp_idx] == 'B') {
+				//DecrementY transitions to halt state and moves one right upon encountering a blank
+				exp_idx++;
+				traceStepExp(trace, "Halt", mult_idx, exp_idx, tape, mult_tape);
+				eraseFront(tape, exp_idx - 1);
+				//return the position of the last bit of the second input before changing the tape
+				return exp_idx - 2;
+			}
+		
+			//otherwise, go to the leftmost cell of the section of tape that stores the result so far
+			PROFILE_STATE(ctx, "MoveToResFromY");
+			traceStepExp(trace, "MoveToResFromY", mult_idx, exp_idx, tape, mult_tape);
+			runAddOneX(tape, exp_idx, ctx);
+
+			//Write the result as the first arg on the multiplication tape, plus a blank afterward
+			PROFILE_STATE(ctx, "WriteResAsMultArg");
+			traceStepExp(trace, "WriteResAsMultArg", mult_idx, exp_idx, tape, mult_tape);
+			copyUntilBlank(tape, mult_tape, exp_idx, mult_idx, ctx);
+		
+			//Next arg on mult tape will start after the new blank, not before it
+			mult_idx += 2;
+
+			//Now x will be the second arg on the mult tape. Go left to the rightmost bit of y first...
+			PROFILE_STATE(ctx, "MoveToYForXWrite");
+			traceStepExp(trace, "MoveToYForXWrite", mult_idx, exp_idx, tape, mult_tape);
+			runGetNextY(tape, exp_idx, ctx);
+
+			//...and then go left to the rightmost bit of x, and then...
+			PROFILE_STATE(ctx, "MoveToXForXWrite");
+			traceStepExp(trace, "MoveToXForXWrite", mult_idx, exp_idx, tape, mult_tape);
+			runGetNextY(tape, exp_idx, ctx);
+
+			//finally go left to the first cell of x to begin write to mult tape
+			PROFILE_STATE(ctx, "MoveToXBeginFromXEndForXWrite");
+			traceStepExp(trace, "MoveToXBeginFromXEndForXWrite", mult_idx, exp_idx, tape, mult_tape);
+			runGetNextX(tape, exp_idx, ctx);
+
+			//write x to the mult tape at the second arg position
+			PROFILE_STATE(ctx, "WriteXAsMultArg");
+			traceStepExp(trace, "WriteXAsMultArg", mult_idx, exp_idx, tape, mult_tape);
+			copyUntilBlank(tape, mult_tape, exp_idx, mult_idx, ctx);
+		
+			/* WriteXAsMultArg should move exp tape head right once to leftmost bit of y from blank that causes transition
+			 * instead of left once as in copyUntilBlank function default
+			 */
+			exp_idx += 2;
+
+			//WriteXAsMultArg should similarly move mult tape head to cell after the blank
+			mult_idx += 2;
+		
+			//now write the initial result cell to the mult tape, move right, and transition
+			PROFILE_STATE(ctx, "InitMultRes");
+			traceStepExp(trace, "InitMultRes", mult_idx, exp_idx, tape, mult_tape);
+			writeSafe(mult_tape, '0', mult_idx);
+			mult_idx++;
+			ctx.steps++;
+		
+			//write a blank (since the mult tape is reused, some unwanted bit characters could be here) and move left
+			PROFILE_STATE(ctx, "MakeLastBlankInMult");
+			traceStepExp(trace, "MakeLastBlankInMult", mult_idx, exp_idx, tape, mult_tape);
+			writeSafe(mult_tape, 'B', mult_idx);
+			mult_idx--;
+			ctx.steps++;
+
+			/* this state moves left for non-blank characters, and moves left and transitions for blanks,
+			 * to reach the rightmost cell of the second input on the mult tape
+			 */
+			PROFILE_STATE(ctx, "MultMoveToYAfterInitResWrite");
+			traceStepExp(trace, "MultMoveToYAfterInitResWrite", mult_idx, exp_idx, tape, mult_tape);
+			runGetNextY(mult_tape, mult_idx, ctx);
+
+			//now go back to the last bit of the first input on the mult tape...
+			PROFILE_STATE(ctx, "ToFirstInputEndInMultAfterXWrite");
+			traceStepExp(trace, "ToFirstInputEndInMultAfterXWrite", mult_idx, exp_idx, tape, mult_tape);
+			runGetNextY(mult_tape, mult_idx, ctx);
+
+			//and finally go to the first bit of the first input to start the multiplication
+			PROFILE_STATE(ctx, "ToFirstInputBeginInMultAfterArgWrites");
+			traceStepExp(trace, "ToFirstInputBeginInMultAfterArgWrites", mult_idx, exp_idx, tape, mult_tape);
+			runGetNextX(mult_tape, mult_idx, ctx);
+
+			//Perform the multiplication (treat the entire process and all its state transitions as a black box in trace)
+			PROFILE_STATE(ctx, "Mult*");
+			traceStepExp(trace, "Mult*", mult_idx, exp_idx, tape, mult_tape);
+		}
+		//the mult tape doesn't hold the inputs of a run that is picked up part way through, so it can't be cached
+		if (ctx.trace_nested)
+			mult_idx = nestedMultSim(add_tape, mult_tape, tape, exp_idx, trace, ctx);
+		else if (in_mult)
+			mult_idx = multSim(add_tape, mult_tape, trace, ctx, false);
+		else
+			mult_idx = cachedMultSim(add_tape, mult_tape, trace, ctx);
+		in_mult = false;
+
+		//Now to copy the product, need to move exp tape's head first from its current position, at the leftmost cell of y,
+		//to the leftmost result cell
+		PROFILE_STATE(ctx, "ToExpResultForUpdate");
+		traceStepExp(trace, "ToExpResultForUpdate", mult_idx, exp_idx, tape, mult_tape);
+		runAddOneX(tape, exp_idx, ctx);
+
+		//Now that the tape heads are positioned correctly, write the product to the result cells on the exp tape
+		PROFILE_STATE(ctx, "WriteProduct");
+		traceStepExp(trace, "WriteProduct", mult_idx, exp_idx, tape, mult_tape);
+		copyUntilBlank(mult_tape, tape, mult_idx, exp_idx, ctx);
+
+		/* All that's left is to move to the first cell of the first arg to start the next iteration in each tape
+		 * As in the multSim, this abbreviates 3 states within one (the combined result is going left until 3 blanks
+		 * have been seen, then positioning the tape head 1 position right of the 3rd blank
+		 */
+		PROFILE_STATE(ctx, "FirstCellFromEndExpTape*");
+		traceStepExp(trace, "FirstCellFromEndExpTape*", mult_idx, exp_idx, tape, mult_tape);
+		moveToMultStart(tape, exp_idx, ctx);
+
+		PROFILE_STATE(ctx, "FirstCellFromEndMultTape*");
+		traceStepExp(trace, "FirstCellFromEndMultTape*", mult_idx, exp_idx, tape, mult_tape);
+		moveToMultStart(mult_tape, mult_idx, ctx);
+	}
+}
+
+//simulate exponentiation x^y in a Turing machine for inputs x and y
+template <class Tape = OriginTape>
+Tape exp(const BigNum &x, const BigNum &y, Tracer &trace, SimContext &ctx) {
+	Tape tape;
+	Tape mult_tape;
+	//only mult will use this tape
+	Tape add_tape;
+	attachTape(ctx, tape);
+	attachTape(ctx, mult_tape);
+	attachTape(ctx, add_tape);
+	//no number on any of the tapes gets longer than the result
+	size_t result_bits = powCells(x, y);
+	reserveTape(tape, tapeHint(result_bits, 3));
+	reserveTape(mult_tape, tapeHint(result_bits, 3));
+	reserveTape(add_tape, tapeHint(result_bits, 2));
+	PROFILE_TAPE(ctx, "Exp", tape);
+	PROFILE_TAPE(ctx, "Mult", mult_tape);
+	PROFILE_TAPE(ctx, "Add", add_tape);
+	if (!resuming(ctx)) {
+		//exp tape stores inputs x and y, and a result (which starts as 1)
+		initTape(x, y, tape);
+		tape.push_back('1');
+		tape.push_back('B');
+
+		//mult_tape and add_tape are entirely blank initially
+		mult_tape.push_back('B');
+		add_tape.push_back('B');
+
+		/* only mult tape and exp tape will appear in trace - all modifications and accesses to the add are lost
+		* in the abbreviated trace format since they're now less "interesting"
+		*/
+		trace.text("Abbreviated Trace for " + x.toString() + " ^ " + y.toString() + " (x to the yth power)\n\n");
+		traceStepExp(trace, "Start", 0, 0, tape, mult_tape, true);
+
+		//the start state moves the heads right
+		ctx.steps++;
+	}
+	expSim(add_tape, mult_tape, tape, trace, ctx);
+	return tape;
+}
+
+vector<char> exp(const BigNum &x, const BigNum &y, string &trace) {
+	StringTraceSink sink(trace);
+	TextTracer text_trace(sink);
+	SimContext ctx;
+	trace.clear();
+	return cells(exp(x, y, text_trace, ctx));
+}
+
+/* The machines above multiply by adding y x times and raise to a power by multiplying y times, so their steps grow
+ * with the values of the inputs. mult-fast and exp-fast take steps that grow with the number of bits instead:
+ * mult-fast adds y shifted by i cells into the product for each 1 at bit i of x, and exp-fast squares a copy of x
+ * once for each bit of y, multiplying it into the result (with mult-fast) where the bit is 1. They are built from
+ * the same states as the others, plus the ones below, and are traced the same way.
+ */
+
+//move each cell of a number one to the right, keeping the last cell read in the state (carry), which starts as a 0
+template <class Tape>
+TapeIdx shiftRight(Tape &tape, TapeIdx idx, char &carry) {
+	char cell = tape[idx];
+	tape[idx] = carry;
+	if (cell == 'B') {
+		//the number is one cell longer
+		writeSafe(tape, 'B', idx + 1);
+		return -idx + 1;
+	}
+	carry = cell;
+	return idx + 1;
+}
+
+//write a blank over each cell up to the next blank, then go left once and transition
+template <class Tape>
+TapeIdx eraseCell(Tape &tape, TapeIdx idx) {
+	if (tape[idx] == 'B')
+		return -idx + 1;
+	tape[idx] = 'B';
+	return idx + 1;
+}
+
+//go left over blanks up to the first cell that isn't one, and transition there
+template <class Tape>
+TapeIdx skipBlanksLeft(const Tape &tape, TapeIdx idx) {
+	if (tape[idx] != 'B')
+		return -idx;
+	return idx - 1;
+}
+
+/* add the number from idx_r on the read tape into the one from idx_w on the write tape, a cell of each in a step
+ * with the carry kept in the state, until the read tape has a blank and there is nothing left to carry. A blank on the
+ * write tape counts as a 0 and the sum grows over it. Like copyUntilBlank, the heads are left on the last cells added
+ * (the read head waits on its blank while the carry runs on).
+ */
+template <class Tape>
+void addUntilBlank(const Tape &tape_read, Tape &tape_write, TapeIdx &idx_r, TapeIdx &idx_w, SimContext &ctx) {
+	PROFILE_SECTION(ctx, "addUntilBlank");
+	int carry = 0;
+	while (tape_read[idx_r] != 'B' || carry) {
+		char cell = tape_write[idx_w];
+		int sum = carry + (tape_read[idx_r] == '1') + (cell == '1');
+		if (cell == 'B')
+			writeSafe(tape_write, 'B', idx_w + 1);
+		tape_write[idx_w] = sum & 1 ? '1' : '0';
+		carry = sum >> 1;
+		if (tape_read[idx_r] != 'B')
+			idx_r++;
+		idx_w++;
+		ctx.steps++;
+	}
+	//and one for the blank
+	ctx.steps++;
+	idx_r--;
+	idx_w--;
+}
+
+//record the configuration of the shift and add multiplication TM at the current state in the trace
+template <class Tape>
+void traceStepFast(Tracer &trace, const char *state_name, TapeIdx add_idx, TapeIdx shift_idx, TapeIdx mult_idx, const Tape &mult_tape,
+		const Tape &add_tape, const Tape &shift_tape, bool initial=false) {
+	TracedTape tapes[3] = {{"Add", add_idx, view(add_tape)}, {"Shift", shift_idx, view(shift_tape)}, {"Mult", mult_idx, view(mult_tape)}};
+	trace.config(state_name, tapes, 3, initial);
+}
+
+/* simulate a shift and add multiplication on a mult tape of the form BxByB0B, with the product built up on the add
+ * tape and y shifted along on the shift tape. The mult tape head reads x a bit at a time and stays on it while the
+ * other heads add and shift, so the product is written back after y once x runs out. Returns the index of the first
+ * cell of the product, like multSim.
+ */
+template <class Tape>
+TapeIdx multFastSim(Tape &add_tape, Tape &shift_tape, Tape &tape, Tracer &trace, SimContext &ctx, bool detailed = true) {
+	TapeIdx mult_idx = 1;
+	TapeIdx add_idx = 1;
+	TapeIdx shift_idx = 1;
+	PROFILE_MACHINE(ctx, "mult-fast");
+	//as with multSim, a mult run as Mult* is only traced with ctx.trace_nested
+	bool traced = detailed || ctx.trace_nested;
+
+	PROFILE_STATE(ctx, "MoveToYFromX");
+	if (traced)
+		traceStepFast(trace, "MoveToYFromX", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+	runAddOneX(tape, mult_idx, ctx);
+	//y is shifted one cell further for each bit of x, starting from bit 0
+	PROFILE_STATE(ctx, "WriteAddend");
+	if (traced)
+		traceStepFast(trace, "WriteAddend", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+	copyUntilBlank(tape, shift_tape, mult_idx, shift_idx, ctx);
+	mult_idx += 2;
+	//and the product starts as the 0 after it
+	PROFILE_STATE(ctx, "WriteSum");
+	if (traced)
+		traceStepFast(trace, "WriteSum", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+	copyUntilBlank(tape, add_tape, mult_idx, add_idx, ctx);
+
+	PROFILE_STATE(ctx, "FirstCellFromEndAddTape*");
+	if (traced)
+		traceStepFast(trace, "FirstCellFromEndAddTape*", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+	runGetNextX(add_tape, add_idx, ctx);
+	PROFILE_STATE(ctx, "FirstCellFromEndShiftTape*");
+	if (traced)
+		traceStepFast(trace, "FirstCellFromEndShiftTape*", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+	runGetNextX(shift_tape, shift_idx, ctx);
+	PROFILE_STATE(ctx, "FirstCellFromEndMultTape*");
+	if (traced)
+		traceStepFast(trace, "FirstCellFromEndMultTape*", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+	moveToMultStart(tape, mult_idx, ctx);
+
+	while (1) {
+		//read the next bit of x and move right past it
+		PROFILE_STATE(ctx, "ReadXBit");
+		if (traced)
+			traceStepFast(trace, "ReadXBit", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+		char bit = tape[mult_idx];
+		mult_idx++;
+		ctx.steps++;
+
+		if (bit == 'B') {
+			//x has run out, so the product goes over the 0 after y
+			PROFILE_STATE(ctx, "MoveToOutputFromY");
+			if (traced)
+				traceStepFast(trace, "MoveToOutputFromY", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+			runAddOneX(tape, mult_idx, ctx);
+			PROFILE_STATE(ctx, "WriteSumBack");
+			if (traced)
+				traceStepFast(trace, "WriteSumBack", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+			copyUntilBlank(add_tape, tape, add_idx, mult_idx, ctx);
+			//leave the add tape head where the next run starts, and the mult tape head on the blank before the product
+			PROFILE_STATE(ctx, "FirstCellFromEndAddTape*");
+			if (traced)
+				traceStepFast(trace, "FirstCellFromEndAddTape*", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+			runGetNextX(add_tape, add_idx, ctx);
+			PROFILE_STATE(ctx, "MoveToOutputStart");
+			if (traced)
+				traceStepFast(trace, "MoveToOutputStart", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+			runGetNextX(tape, mult_idx, ctx);
+			mult_idx--;
+			if (detailed) {
+				traceStepFast(trace, "Halt", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+				eraseFront(tape, mult_idx);
+			}
+			return mult_idx + 1;
+		}
+
+		if (bit == '1') {
+			//add y, shifted as far as the bit is, to the product
+			PROFILE_STATE(ctx, "AddAddend");
+			if (traced)
+				traceStepFast(trace, "AddAddend", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+			addUntilBlank(shift_tape, add_tape, shift_idx, add_idx, ctx);
+			PROFILE_STATE(ctx, "FirstCellFromEndAddTape*");
+			if (traced)
+				traceStepFast(trace, "FirstCellFromEndAddTape*", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+			runGetNextX(add_tape, add_idx, ctx);
+			PROFILE_STATE(ctx, "FirstCellFromEndShiftTape*");
+			if (traced)
+				traceStepFast(trace, "FirstCellFromEndShiftTape*", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+			runGetNextX(shift_tape, shift_idx, ctx);
+		}
+
+		//double y for the next bit
+		PROFILE_STATE(ctx, "ShiftAddend");
+		if (traced)
+			traceStepFast(trace, "ShiftAddend", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+		char carry = '0';
+		while (shift_idx > 0) {
+			shift_idx = shiftRight(shift_tape, shift_idx, carry);
+			ctx.steps++;
+		}
+		shift_idx = -shift_idx;
+		PROFILE_STATE(ctx, "FirstCellFromEndShiftTape*");
+		if (traced)
+			traceStepFast(trace, "FirstCellFromEndShiftTape*", add_idx, shift_idx, mult_idx, tape, add_tape, shift_tape);
+		runGetNextX(shift_tape, shift_idx, ctx);
+	}
+}
+
+//multiply x and y with the shift and add TM
+template <class Tape = OriginTape>
+Tape multFast(const BigNum &x, const BigNum &y, Tracer &trace, SimContext &ctx) {
+	Tape tape;
+	Tape add_tape;
+	Tape shift_tape;
+	size_t product_bits = bitCells(x) + bitCells(y);
+	reserveTape(tape, tapeHint(product_bits, 3));
+	reserveTape(add_tape, tapeHint(product_bits, 1));
+	reserveTape(shift_tape, tapeHint(product_bits, 1));
+	PROFILE_TAPE(ctx, "Mult", tape);
+	PROFILE_TAPE(ctx, "Add", add_tape);
+	PROFILE_TAPE(ctx, "Shift", shift_tape);
+	//the same mult tape as mult, with the other two blank
+	initTape(x, y, tape);
+	tape.push_back('0');
+	tape.push_back('B');
+	add_tape.push_back('B');
+	shift_tape.push_back('B');
+	trace.text("Abbreviated Trace for " + x.toString() + " x " + y.toString() + " (shift and add)\n\n");
+	traceStepFast(trace, "Start", 0, 0, 0, tape, add_tape, shift_tape, true);
+	//the start state moves the heads right
+	ctx.steps++;
+	multFastSim(add_tape, shift_tape, tape, trace, ctx);
+	return tape;
+}
+
+//multFastSim as exp-fast's Mult* state, with its states in exp-fast's trace (ctx.trace_nested)
+template <class Tape>
+TapeIdx nestedMultFastSim(Tape &add_tape, Tape &shift_tape, Tape &mult_tape, const Tape &exp_tape, TapeIdx exp_idx, Tracer &trace,
+		SimContext &ctx) {
+	TracedTape outer = {"Exp", exp_idx, view(exp_tape)};
+	NestedTracer nested(trace, "Mult*", "Mult", &outer, 1);
+	return multFastSim(add_tape, shift_tape, mult_tape, nested, ctx, false);
+}
+
+/* after exp-fast has written the arguments of a multiplication on the mult tape, finish it with a 0 for the product
+ * and run it as Mult*, leaving the mult tape head on the first cell of the product
+ */
+template <class Tape>
+void multFastFromArgs(Tape &add_tape, Tape &shift_tape, Tape &mult_tape, const Tape &tape, TapeIdx &mult_idx, TapeIdx exp_idx,
+		Tracer &trace, SimContext &ctx) {
+	PROFILE_STATE(ctx, "InitMultRes");
+	traceStepExp(trace, "InitMultRes", mult_idx, exp_idx, tape, mult_tape);
+	writeSafe(mult_tape, '0', mult_idx);
+	mult_idx++;
+	ctx.steps++;
+	//the mult tape is reused, so the blank after the 0 has to be written
+	PROFILE_STATE(ctx, "MakeLastBlankInMult");
+	traceStepExp(trace, "MakeLastBlankInMult", mult_idx, exp_idx, tape, mult_tape);
+	writeSafe(mult_tape, 'B', mult_idx);
+	mult_idx--;
+	ctx.steps++;
+	PROFILE_STATE(ctx, "FirstCellFromEndMultTape*");
+	traceStepExp(trace, "FirstCellFromEndMultTape*", mult_idx, exp_idx, tape, mult_tape);
+	moveToMultStart(mult_tape, mult_idx, ctx);
+
+	PROFILE_STATE(ctx, "Mult*");
+	traceStepExp(trace, "Mult*", mult_idx, exp_idx, tape, mult_tape);
+	if (ctx.trace_nested)
+		mult_idx = nestedMultFastSim(add_tape, shift_tape, mult_tape, tape, exp_idx, trace, ctx);
+	else
+		mult_idx = multFastSim(add_tape, shift_tape, mult_tape, trace, ctx, false);
+}
+
+/* simulate a square and multiply exponentiation on an exp tape of the form BxByB1B. A copy of x, the base, goes after
+ * the result, and the bits of y are read from bit 0 up, each one blanked once it is read so the head can find the
+ * next one from the right. The base is squared for each bit after the first, and multiplied into the result for
+ * each 1. Both run as Mult* with mult-fast, which leaves its arguments on the mult tape, so a product that grows
+ * into the base is written back together with the base.
+ */
+template <class Tape>
+TapeIdx expFastSim(Tape &add_tape, Tape &shift_tape, Tape &mult_tape, Tape &tape, Tracer &trace, SimContext &ctx) {
+	TapeIdx mult_idx = 1;
+	TapeIdx exp_idx = 1;
+	PROFILE_MACHINE(ctx, "exp-fast");
+
+	//copy x to the end of the exp tape by way of the mult tape
+	PROFILE_STATE(ctx, "WriteXAsMultArg");
+	traceStepExp(trace, "WriteXAsMultArg", mult_idx, exp_idx, tape, mult_tape);
+	copyUntilBlank(tape, mult_tape, exp_idx, mult_idx, ctx);
+	PROFILE_STATE(ctx, "MoveToBaseFromX*");
+	traceStepExp(trace, "MoveToBaseFromX*", mult_idx, exp_idx, tape, mult_tape);
+	runAddOneX(tape, exp_idx, ctx);
+	runAddOneX(tape, exp_idx, ctx);
+	runAddOneX(tape, exp_idx, ctx);
+	PROFILE_STATE(ctx, "FirstCellFromEndMultTape*");
+	traceStepExp(trace, "FirstCellFromEndMultTape*", mult_idx, exp_idx, tape, mult_tape);
+	runGetNextX(mult_tape, mult_idx, ctx);
+	PROFILE_STATE(ctx, "WriteBase");
+	traceStepExp(trace, "WriteBase", mult_idx, exp_idx, tape, mult_tape);
+	copyUntilBlank(mult_tape, tape, mult_idx, exp_idx, ctx);
+	PROFILE_STATE(ctx, "FirstCellFromEndMultTape*");
+	traceStepExp(trace, "FirstCellFromEndMultTape*", mult_idx, exp_idx, tape, mult_tape);
+	runGetNextX(mult_tape, mult_idx, ctx);
+	PROFILE_STATE(ctx, "FirstCellFromEndExpTape*");
+	traceStepExp(trace, "FirstCellFromEndExpTape*", mult_idx, exp_idx, tape, mult_tape);
+	moveToMultStart(tape, exp_idx, ctx);
+
+	//the first bit has no square before it, so it is read by a state of its own
+	bool first = true;
+	while (1) {
+		//read the lowest bit of y left, blank it and move right
+		const char *read_state = first ? "ReadFirstYBit" : "ReadYBit";
+		PROFILE_STATE(ctx, read_state);
+		traceStepExp(trace, read_state, mult_idx, exp_idx, tape, mult_tape);
+		char bit = tape[exp_idx];
+		tape[exp_idx] = 'B';
+		exp_idx++;
+		ctx.steps++;
+
+		if (bit == 'B') {
+			//y has run out, so the base is erased from the end of the tape to leave the result
+			PROFILE_STATE(ctx, "MoveToBaseFromRes");
+			traceStepExp(trace, "MoveToBaseFromRes", mult_idx, exp_idx, tape, mult_tape);
+			runAddOneX(tape, exp_idx, ctx);
+			PROFILE_STATE(ctx, "EraseBase");
+			traceStepExp(trace, "EraseBase", mult_idx, exp_idx, tape, mult_tape);
+			while (exp_idx > 0) {
+				exp_idx = eraseCell(tape, exp_idx);
+				ctx.steps++;
+			}
+			exp_idx = -exp_idx;
+			PROFILE_STATE(ctx, "MoveToResEnd");
+			traceStepExp(trace, "MoveToResEnd", mult_idx, exp_idx, tape, mult_tape);
+			while (exp_idx > 0) {
+				exp_idx = skipBlanksLeft(tape, exp_idx);
+				ctx.steps++;
+			}
+			exp_idx = -exp_idx;
+			PROFILE_STATE(ctx, "MoveToResStart");
+			traceStepExp(trace, "MoveToResStart", mult_idx, exp_idx, tape, mult_tape);
+			runGetNextX(tape, exp_idx, ctx);
+			traceStepExp(trace, "Halt", mult_idx, exp_idx, tape, mult_tape);
+			eraseFront(tape, exp_idx - 1);
+			return exp_idx;
+		}
+
+		if (!first) {
+			//square the base: write it twice on the mult tape...
+			PROFILE_STATE(ctx, "MoveToBaseFromY*");
+			traceStepExp(trace, "MoveToBaseFromY*", mult_idx, exp_idx, tape, mult_tape);
+			runAddOneX(tape, exp_idx, ctx);
+			runAddOneX(tape, exp_idx, ctx);
+			PROFILE_STATE(ctx, "WriteBaseAsMultArg");
+			traceStepExp(trace, "WriteBaseAsMultArg", mult_idx, exp_idx, tape, mult_tape);
+			copyUntilBlank(tape, mult_tape, exp_idx, mult_idx, ctx);
+			mult_idx += 2;
+			PROFILE_STATE(ctx, "MoveToBaseStart");
+			traceStepExp(trace, "MoveToBaseStart", mult_idx, exp_idx, tape, mult_tape);
+			runGetNextX(tape, exp_idx, ctx);
+			PROFILE_STATE(ctx, "WriteBaseAsSecondMultArg");
+			traceStepExp(trace, "WriteBaseAsSecondMultArg", mult_idx, exp_idx, tape, mult_tape);
+			copyUntilBlank(tape, mult_tape, exp_idx, mult_idx, ctx);
+			mult_idx += 2;
+			multFastFromArgs(add_tape, shift_tape, mult_tape, tape, mult_idx, exp_idx, trace, ctx);
+
+			//...and write the square over it, at the end of the tape where it has room to grow
+			PROFILE_STATE(ctx, "MoveToBaseStart");
+			traceStepExp(trace, "MoveToBaseStart", mult_idx, exp_idx, tape, mult_tape);
+			runGetNextX(tape, exp_idx, ctx);
+			PROFILE_STATE(ctx, "WriteSquare");
+			traceStepExp(trace, "WriteSquare", mult_idx, exp_idx, tape, mult_tape);
+			copyUntilBlank(mult_tape, tape, mult_idx, exp_idx, ctx);
+			PROFILE_STATE(ctx, "FirstCellFromEndMultTape*");
+			traceStepExp(trace, "FirstCellFromEndMultTape*", mult_idx, exp_idx, tape, mult_tape);
+			moveToMultStart(mult_tape, mult_idx, ctx);
+			PROFILE_STATE(ctx, "FirstCellFromEndExpTape*");
+			traceStepExp(trace, "FirstCellFromEndExpTape*", mult_idx, exp_idx, tape, mult_tape);
+			moveToMultStart(tape, exp_idx, ctx);
+		}
+		first = false;
+
+		if (bit == '1') {
+			//multiply the result by the base
+			PROFILE_STATE(ctx, "MoveToResFromY");
+			traceStepExp(trace, "MoveToResFromY", mult_idx, exp_idx, tape, mult_tape);
+			runAddOneX(tape, exp_idx, ctx);
+			PROFILE_STATE(ctx, "WriteResAsMultArg");
+			traceStepExp(trace, "WriteResAsMultArg", mult_idx, exp_idx, tape, mult_tape);
+			copyUntilBlank(tape, mult_tape, exp_idx, mult_idx, ctx);
+			mult_idx += 2;
+			exp_idx += 2;
+			PROFILE_STATE(ctx, "WriteBaseAsSecondMultArg");
+			traceStepExp(trace, "WriteBaseAsSecondMultArg", mult_idx, exp_idx, tape, mult_tape);
+			copyUntilBlank(tape, mult_tape, exp_idx, mult_idx, ctx);
+			mult_idx += 2;
+			multFastFromArgs(add_tape, shift_tape, mult_tape, tape, mult_idx, exp_idx, trace, ctx);
+
+			//the product can be longer than the result, so the base is written again after it
+			PROFILE_STATE(ctx, "MoveToResFromBase*");
+			traceStepExp(trace, "MoveToResFromBase*", mult_idx, exp_idx, tape, mult_tape);
+			moveToInputStart(tape, exp_idx, ctx);
+			PROFILE_STATE(ctx, "WriteProduct");
+			traceStepExp(trace, "WriteProduct", mult_idx, exp_idx, tape, mult_tape);
+			copyUntilBlank(mult_tape, tape, mult_idx, exp_idx, ctx);
+			exp_idx += 2;
+			PROFILE_STATE(ctx, "MultMoveToBase*");
+			traceStepExp(trace, "MultMoveToBase*", mult_idx, exp_idx, tape, mult_tape);
+			moveToInputStart(mult_tape, mult_idx, ctx);
+			PROFILE_STATE(ctx, "WriteBaseBack");
+			traceStepExp(trace, "WriteBaseBack", mult_idx, exp_idx, tape, mult_tape);
+			copyUntilBlank(mult_tape, tape, mult_idx, exp_idx, ctx);
+			PROFILE_STATE(ctx, "FirstCellFromEndMultTape*");
+			traceStepExp(trace, "FirstCellFromEndMultTape*", mult_idx, exp_idx, tape, mult_tape);
+			moveToInputStart(mult_tape, mult_idx, ctx);
+			PROFILE_STATE(ctx, "FirstCellFromEndExpTape*");
+			traceStepExp(trace, "FirstCellFromEndExpTape*", mult_idx, exp_idx, tape, mult_tape);
+			moveToMultStart(tape, exp_idx, ctx);
+		}
+	}
+}
+
+//raise x to the yth power with the square and multiply TM
+template <class Tape = OriginTape>
+Tape expFast(const BigNum &x, const BigNum &y, Tracer &trace, SimContext &ctx) {
+	Tape tape;
+	Tape mult_tape;
+	//only mult-fast uses these
+	Tape add_tape;
+	Tape shift_tape;
+	//the base is squared no further than x^y, and a product takes at most the bits of both its arguments
+	size_t result_bits = powCells(x, y);
+	reserveTape(tape, tapeHint(result_bits, 4));
+	reserveTape(mult_tape, tapeHint(2 * result_bits, 3));
+	reserveTape(add_tape, tapeHint(2 * result_bits, 1));
+	reserveTape(shift_tape, tapeHint(2 * result_bits, 1));
+	PROFILE_TAPE(ctx, "Exp", tape);
+	PROFILE_TAPE(ctx, "Mult", mult_tape);
+	PROFILE_TAPE(ctx, "Add", add_tape);
+	PROFILE_TAPE(ctx, "Shift", shift_tape);
+	initTape(x, y, tape);
+	tape.push_back('1');
+	tape.push_back('B');
+	mult_tape.push_back('B');
+	add_tape.push_back('B');
+	shift_tape.push_back('B');
+	trace.text("Abbreviated Trace for " + x.toString() + " ^ " + y.toString() + " (x to the yth power, by squaring)\n\n");
+	traceStepExp(trace, "Start", 0, 0, tape, mult_tape, true);
+	//the start state moves the heads right
+	ctx.steps++;
+	expFastSim(add_tape, shift_tape, mult_tape, tape, trace, ctx);
+	return tape;
+}
+
+//read a name table index, adding the name to the table if it is a new one
+unsigned readDeltaName(DeltaReader &in, deque<string> &names) {
+	unsigned long long id = in.varint();
+	if (id < names.size())
+		return id;
+	if (id > names.size())
+		throw runtime_error("delta trace refers to an undefined name");
+	string name(in.varint(), '\0');
+	in.bytes(&name[0], name.size());
+	names.push_back(name);
+	return id;
+}
+
+//apply the tape part of a record, after its kind, to what is known about that tape
+void readDeltaTape(DeltaReader &in, DeltaShadow &shadow, unsigned char kind) {
+	size_t len = in.varint();
+	if (kind == DELTA_KEYFRAME) {
+		shadow.cells.resize(len);
+		in.bytes(shadow.cells.data(), len);
+		return;
+	}
+	if (kind != DELTA_CHANGES)
+		throw runtime_error("unknown tape encoding in delta trace");
+	shadow.cells.resize(len, 'B');
+	size_t pos = 0;
+	for (unsigned long long runs = in.varint(); runs > 0; runs--) {
+		pos += in.varint();
+		size_t run_len = in.varint();
+		if (pos + run_len > len)
+			throw runtime_error("delta trace writes past the end of a tape");
+		in.bytes(shadow.cells.data() + pos, run_len);
+		pos += run_len;
+	}
+}
+
+void readDeltaTape(DeltaReader &in, DeltaShadow &shadow) {
+	readDeltaTape(in, shadow, in.byte());
+}
+
+//apply the tape part of a STEP or HALT record, which usually only changes the cell under the previous head
+void readDeltaStepTape(DeltaReader &in, DeltaShadow &shadow, long long prev_idx) {
+	unsigned char kind = in.byte();
+	if (kind == DELTA_KEYFRAME || kind == DELTA_CHANGES) {
+		readDeltaTape(in, shadow, kind);
+		return;
+	}
+	if ((kind & ~(DELTA_HEAD_CELL | DELTA_GROWN)) != DELTA_STEP_CELLS)
+		throw runtime_error("unknown tape encoding in delta trace");
+	if (kind & DELTA_HEAD_CELL) {
+		if (prev_idx < 0 || prev_idx >= (long long)shadow.cells.size())
+			throw runtime_error("delta trace writes past the end of a tape");
+		shadow.cells[prev_idx] = (char)in.byte();
+	}
+	if (kind & DELTA_GROWN) {
+		size_t old_len = shadow.cells.size();
+		shadow.cells.resize(old_len + in.varint());
+		in.bytes(shadow.cells.data() + old_len, shadow.cells.size() - old_len);
+	}
+}
+
+//expand a trace written by DeltaTracer, handing every record to another tracer
+void decodeDeltaTrace(istream &in, Tracer &trace) {
+	DeltaReader reader(in);
+	char magic[4];
+	reader.bytes(magic, 4);
+	if (memcmp(magic, DELTA_MAGIC, 4) != 0)
+		throw runtime_error("not a delta trace");
+	if (reader.byte() != DELTA_VERSION)
+		throw runtime_error("unsupported delta trace version");
+	//keyframe interval only matters to readers that seek
+	reader.varint();
+
+	//a deque, so the names passed to trace stay where they are as more are added
+	deque<string> names;
+	string str;
+	DeltaShadow step_tape;
+	vector<DeltaShadow> config_tapes;
+	vector<unsigned> tape_names;
+	vector<TracedTape> tapes;
+	while (!reader.atEnd()) {
+		unsigned char tag = reader.byte();
+		if (tag == DELTA_TEXT) {
+			str.resize(reader.varint());
+			reader.bytes(&str[0], str.size());
+			trace.text(str);
+		}
+		else if (tag == DELTA_STEP || tag == DELTA_HALT) {
+			unsigned state = tag == DELTA_STEP ? readDeltaName(reader, names) : 0;
+			TapeIdx prev_idx = step_tape.idx;
+			step_tape.idx += unzigzag(reader.varint());
+			readDeltaStepTape(reader, step_tape, prev_idx);
+			if (tag == DELTA_STEP)
+				trace.step(names[state].c_str(), step_tape.idx, view(step_tape.cells));
+			else
+				trace.halt(step_tape.idx, view(step_tape.cells));
+		}
+		else if (tag == DELTA_CONFIG) {
+			unsigned state = readDeltaName(reader, names);
+			bool initial = reader.byte() != 0;
+			size_t count = reader.varint();
+			if (config_tapes.size() < count)
+				config_tapes.resize(count);
+			tape_names.resize(count);
+			for (size_t i = 0; i < count; i++) {
+				tape_names[i] = readDeltaName(reader, names);
+				config_tapes[i].idx += unzigzag(reader.varint());
+				readDeltaTape(reader, config_tapes[i]);
+			}
+			//names can't be looked up until the whole record is read, since reading may grow the table
+			tapes.resize(count);
+			for (size_t i = 0; i < count; i++) {
+				TracedTape t = {names[tape_names[i]].c_str(), config_tapes[i].idx, view(config_tapes[i].cells)};
+				tapes[i] = t;
+			}
+			trace.config(names[state].c_str(), tapes.data(), count, initial);
+		}
+		else
+			throw runtime_error("unknown record in delta trace");
+	}
+}
+
+/* Machines can also be given as data: a description lists a machine's tapes, what is on them at the start and its
+ * states, and is turned into one table holding a transition for every state and every combination of symbols under
+ * the heads. A description looks like
+ *
+ *     machine add
+ *     tapes Add
+ *     symbols 0 1 B
+ *     blank B
+ *     input Add B{x}B{y}B
+ *     start Start
+ *     trace steps
+ *     header Trace for {x} + {y}\n\n
+ *     result Add 0
+ *
+ *     state TakeOneX
+ *         0 -> 1 R TakeOneX
+ *         1 -> 0 S AddOneX
+ *         B -> * S Halt
+ *
+ * Rules are "reads -> writes moves next", with one character per tape in reads, writes and moves. In reads * matches
+ * any symbol. In writes * leaves the cell alone and a lowercase letter writes the symbol read on that tape (a for the
+ * first tape). Moves are L, R or S, and the first rule that matches is the one used. A tape is only stored up to the
+ * last cell written to, which shows in traces; a rule ending in "extend" also writes a blank into the cell after each
+ * cell it writes.
+ *
+ * "state Name label Other" makes the state show up in the trace as Other, and "trace transitions Tape..." traces the
+ * named tapes each time the machine moves to a state with a different label rather than every step. A state can
+ * also call another machine with "state Name call machine", followed by "tapes" (the tapes the called machine runs
+ * on), "entry" (the state it starts in) and "return" (the moves its halting transitions make instead of their own,
+ * and the state they go on to). The called machine's states all show up in the trace as Name. "result Tape n" says
+ * that the result comes after the blank n cells right of where that tape's head halts.
+ */
+const int MAX_TAPES = 4;
+const int TABLE_HALT = -1;
+const int TABLE_UNDEFINED = -2;
+
+//a rule of a machine description, with one character per tape of its machine in reads, writes and moves
+struct TableRule {
+	string reads;
+	string writes;
+	string moves;
+	string next;
+	bool extend;
+	int line;
+};
+
+//a state of a machine description, which either has rules or calls another machine
+struct TableStateDef {
+	string name;
+	string label;
+	vector<TableRule> rules;
+	string callee;
+	vector<string> call_tapes;
+	string entry;
+	string ret_moves;
+	string ret_next;
+	int line;
+};
+
+//a machine as read from its description
+struct MachineDef {
+	string name;
+	string source;
+	vector<string> tapes;
+	vector<string> inputs;
+	string symbols;
+	char blank;
+	string start;
+	bool trace_steps;
+	vector<string> traced;
+	string header;
+	string result_tape;
+	int result_offset;
+	vector<TableStateDef> states;
+
+	MachineDef() : blank('B'), start("Start"), trace_steps(true), result_offset(0) {}
+};
+
+/* what a step does to every tape; write holds the symbol read for tapes the step leaves alone, so that every cell
+ * under a head can be stored without checking, and writes has a bit set for each tape really written to
+ */
+struct TableTransition {
+	int next;
+	char write[MAX_TAPES];
+	signed char move[MAX_TAPES];
+	unsigned char writes;
+	bool extend;
+};
+
+/* a state that only moves one head in one direction until that head reads the stop symbol, so a run of it can be
+ * done with one search; tape is -1 for any other state
+ */
+struct TableScan {
+	int tape;
+	int dir;
+	char stop;
+};
+
+//a machine ready to run, with its called machines inlined into one transition table
+struct Machine {
+	string name;
+	int ntapes;
+	vector<string> tape_names;
+	vector<string> inputs;
+	char blank;
+	//symbol code of each character, and how much each tape's symbol code adds to a state's table index
+	int code[256];
+	int place[MAX_TAPES];
+	int combos;
+	vector<string> state_names;
+	vector<int> labels;
+	vector<string> label_names;
+	vector<TableTransition> table;
+	vector<TableScan> scans;
+	int start;
+	bool trace_steps;
+	vector<int> traced;
+	string header;
+	int result_tape;
+	int result_offset;
+};
+
+//a called machine's place in the machine it is inlined into
+struct TableFrame {
+	const MachineDef *def;
+	string prefix;
+	//top level tape for each of def's tapes
+	vector<int> tape_map;
+	//label every state of the frame shows up as, or -1 to use the states' own
+	int label;
+	int parent;
+	string ret_moves;
+	string ret_next;
+};
+
+//machine descriptions by name, which can refer to each other in calls
+class MachineLibrary {
+public:
+	//add every machine described in the input, throwing a runtime_error if the description is bad
+	void load(istream &in, const string &source) {
+		string line;
+		MachineDef *def = NULL;
+		TableStateDef *state = NULL;
+		for (int line_no = 1; getline(in, line); line_no++) {
+			size_t hash = line.find('#');
+			if (hash != string::npos)
+				line.erase(hash);
+			istringstream words(line);
+			string word;
+			if (!(words >> word))
+				continue;
+			string where = source + ":" + to_string(line_no) + ": ";
+			if (word == "machine") {
+				string name;
+				if (!(words >> name))
+					throw runtime_error(where + "machine needs a name");
+				defs[name] = MachineDef();
+				def = &defs[name];
+				def->name = name;
+				def->source = source;
+				state = NULL;
+				last_name = name;
+				continue;
+			}
+			if (!def)
+				throw runtime_error(where + "description has to start with a machine line");
+			if (word == "state") {
+				TableStateDef s;
+				s.line = line_no;
+				if (!(words >> s.name))
+					throw runtime_error(where + "state needs a name");
+				string kind;
+				while (words >> kind) {
+					if (kind == "label" && (words >> s.label))
+						continue;
+					if (kind == "call" && (words >> s.callee))
+						continue;
+					throw runtime_error(where + "expected \"label name\" or \"call machine\" after the state name");
+				}
+				def->states.push_back(s);
+				state = &def->states.back();
+			}
+			else if (state && !state->callee.empty()) {
+				if (word == "tapes")
+					for (string t; words >> t; )
+						state->call_tapes.push_back(t);
+				else if (word == "entry")
+					words >> state->entry;
+				else if (word == "return")
+					words >> state->ret_moves >> state->ret_next;
+				else
+					throw runtime_error(where + "calling states only take tapes, entry and return lines");
+			}
+			else if (state) {
+				TableRule rule;
+				string arrow, flag;
+				rule.reads = word;
+				rule.line = line_no;
+				if (!(words >> arrow >> rule.writes >> rule.moves >> rule.next) || arrow != "->")
+					throw runtime_error(where + "expected a rule of the form \"reads -> writes moves next\"");
+				rule.extend = (words >> flag) && flag == "extend";
+				state->rules.push_back(rule);
+			}
+			else if (word == "tapes") {
+				for (string t; words >> t; )
+					def->tapes.push_back(t);
+				if (def->tapes.empty() || def->tapes.size() > (size_t)MAX_TAPES)
+					throw runtime_error(where + "a machine has from 1 to " + to_string(MAX_TAPES) + " tapes");
+				def->inputs.assign(def->tapes.size(), string(1, def->blank));
+			}
+			else if (word == "symbols") {
+				def->symbols.clear();
+				for (string s; words >> s; ) {
+					if (s.size() != 1 || s == "*" || (s[0] >= 'a' && s[0] <= 'z'))
+						throw runtime_error(where + "symbols are single characters other than * and lowercase letters");
+					def->symbols += s;
+				}
+			}
+			else if (word == "blank") {
+				string b;
+				if (!(words >> b) || b.size() != 1)
+					throw runtime_error(where + "the blank is a single character");
+				def->blank = b[0];
+			}
+			else if (word == "input") {
+				string tape, cells;
+				words >> tape >> cells;
+				def->inputs.at(tapeIndex(*def, tape, where)) = cells;
+			}
+			else if (word == "start")
+				words >> def->start;
+			else if (word == "trace") {
+				string style;
+				words >> style;
+				if (style != "steps" && style != "transitions")
+					throw runtime_error(where + "trace is either steps or transitions");
+				def->trace_steps = style == "steps";
+				def->traced.clear();
+				for (string t; words >> t; )
+					def->traced.push_back(t);
+			}
+			else if (word == "header") {
+				string text;
+				getline(words >> ws, text);
+				def->header = unescape(text);
+			}
+			else if (word == "result") {
+				if (!(words >> def->result_tape >> def->result_offset))
+					throw runtime_error(where + "expected \"result tape offset\"");
+			}
+			else
+				throw runtime_error(where + "unknown directive \'" + word + "\'");
+		}
+	}
+
+	//name of the last machine loaded
+	const string &lastName() const {
+		return last_name;
+	}
+
+	//turn the named machine and every machine it calls into one transition table
+	Machine build(const string &name) const {
+		const MachineDef &top = find(name, "");
+		Machine m;
+		m.name = top.name;
+		m.ntapes = top.tapes.size();
+		m.tape_names = top.tapes;
+		m.inputs = top.inputs;
+		m.blank = top.blank;
+		m.trace_steps = top.trace_steps;
+		m.header = top.header;
+		string where = top.source + ": machine " + top.name + ": ";
+		if (m.ntapes == 0)
+			throw runtime_error(where + "no tapes");
+		if (top.symbols.find(top.blank) == string::npos)
+			throw runtime_error(where + "the blank has to be one of the symbols");
+
+		fill(m.code, m.code + 256, -1);
+		for (size_t i = 0; i < top.symbols.size(); i++)
+			m.code[(unsigned char)top.symbols[i]] = i;
+		m.combos = 1;
+		for (int t = 0; t < m.ntapes; t++) {
+			m.place[t] = m.combos;
+			m.combos *= top.symbols.size();
+		}
+
+		//lay out every state first so that rules can refer to states in any frame
+		vector<TableFrame> frames;
+		vector<int> state_frames;
+		vector<const TableStateDef *> state_defs;
+		map<string, int> ids;
+		map<string, string> aliases;
+		map<string, int> label_ids;
+		vector<int> identity;
+		for (int t = 0; t < m.ntapes; t++)
+			identity.push_back(t);
+		addFrame(top, "", identity, -1, -1, "", "", 0, frames, m, state_frames, state_defs, ids, aliases, label_ids);
+
+		string syms = top.symbols;
+		m.table.resize(m.state_names.size() * m.combos);
+		char read[MAX_TAPES] = {0};
+		for (size_t s = 0; s < m.state_names.size(); s++) {
+			const TableFrame &frame = frames[state_frames[s]];
+			const TableStateDef &sd = *state_defs[s];
+			string state_where = frame.def->source + ":" + to_string(sd.line) + ": ";
+			for (size_t r = 0; r < sd.rules.size(); r++)
+				checkRule(*frame.def, sd.rules[r], frame.def->source + ":" + to_string(sd.rules[r].line) + ": ");
+			for (int c = 0; c < m.combos; c++) {
+				for (int t = 0; t < m.ntapes; t++)
+					read[t] = syms[c / m.place[t] % syms.size()];
+				TableTransition &tr = m.table[s * m.combos + c];
+				const TableRule *rule = NULL;
+				for (size_t r = 0; r < sd.rules.size() && !rule; r++) {
+					const string &reads = sd.rules[r].reads;
+					bool match = true;
+					for (size_t j = 0; j < reads.size() && match; j++)
+						match = reads[j] == '*' || reads[j] == read[frame.tape_map[j]];
+					if (match)
+						rule = &sd.rules[r];
+				}
+				copy(read, read + MAX_TAPES, tr.write);
+				fill(tr.move, tr.move + MAX_TAPES, 0);
+				tr.writes = 0;
+				tr.extend = false;
+				if (!rule) {
+					tr.next = TABLE_UNDEFINED;
+					continue;
+				}
+				for (size_t j = 0; j < rule->writes.size(); j++) {
+					char w = rule->writes[j];
+					if (w >= 'a' && w <= 'z')
+						w = read[frame.tape_map[w - 'a']];
+					if (w != '*') {
+						tr.write[frame.tape_map[j]] = w;
+						tr.writes |= 1 << frame.tape_map[j];
+					}
+					tr.move[frame.tape_map[j]] = moveOf(rule->moves[j]);
+				}
+				tr.extend = rule->extend;
+
+				//a called machine halting goes back to the machine that called it
+				int f = state_frames[s];
+				string next = rule->next;
+				while (next == "Halt" && frames[f].parent >= 0) {
+					const TableFrame &called = frames[f];
+					const TableFrame &caller = frames[called.parent];
+					fill(tr.move, tr.move + MAX_TAPES, 0);
+					for (size_t j = 0; j < called.ret_moves.size(); j++)
+						tr.move[caller.tape_map[j]] = moveOf(called.ret_moves[j]);
+					next = called.ret_next;
+					f = called.parent;
+				}
+				tr.next = next == "Halt" ? TABLE_HALT : resolve(frames[f].prefix + next, ids, aliases, state_where);
+			}
+		}
+		m.start = resolve(top.start, ids, aliases, where);
+		findScans(m, syms);
+
+		for (size_t i = 0; i < top.traced.size(); i++)
+			m.traced.push_back(tapeIndex(top, top.traced[i], where));
+		if (m.traced.empty())
+			m.traced.push_back(0);
+		if (m.trace_steps && m.traced.size() != 1)
+			throw runtime_error(where + "a machine traced every step can only trace one tape");
+		m.result_tape = top.result_tape.empty() ? 0 : tapeIndex(top, top.result_tape, where);
+		m.result_offset = top.result_offset;
+		return m;
+	}
+
+private:
+	map<string, MachineDef> defs;
+	string last_name;
+
+	const MachineDef &find(const string &name, const string &where) const {
+		map<string, MachineDef>::const_iterator it = defs.find(name);
+		if (it == defs.end())
+			throw runtime_error(where + "no machine named \'" + name + "\'");
+		return it->second;
+	}
+
+	static int tapeIndex(const MachineDef &def, const string &tape, const string &where) {
+		for (size_t i = 0; i < def.tapes.size(); i++)
+			if (def.tapes[i] == tape)
+				return i;
+		throw runtime_error(where + "no tape named \'" + tape + "\'");
+	}
+
+	static string unescape(const string &text) {
+		string res;
+		for (size_t i = 0; i < text.size(); i++) {
+			if (text[i] == '\\' && i + 1 < text.size()) {
+				i++;
+				res += text[i] == 'n' ? '\n' : text[i] == 't' ? '\t' : text[i];
+			}
+			else
+				res += text[i];
+		}
+		return res;
+	}
+
+	static int moveOf(char move) {
+		return move == 'L' ? -1 : move == 'R' ? 1 : 0;
+	}
+
+	static void checkMoves(const string &moves, size_t ntapes, const string &where) {
+		if (moves.size() != ntapes || moves.find_first_not_of("LRS") != string::npos)
+			throw runtime_error(where + "moves need an L, R or S for each tape");
+	}
+
+	static void checkRule(const MachineDef &def, const TableRule &rule, const string &where) {
+		size_t n = def.tapes.size();
+		if (rule.reads.size() != n || rule.writes.size() != n)
+			throw runtime_error(where + "reads and writes need a character for each tape");
+		for (size_t j = 0; j < n; j++) {
+			if (rule.reads[j] != '*' && def.symbols.find(rule.reads[j]) == string::npos)
+				throw runtime_error(where + "\'" + rule.reads[j] + "\' is not a symbol");
+			char w = rule.writes[j];
+			if (w >= 'a' && w <= 'z' ? (size_t)(w - 'a') >= n : w != '*' && def.symbols.find(w) == string::npos)
+				throw runtime_error(where + "\'" + w + "\' is neither a symbol nor a tape to copy from");
+		}
+		checkMoves(rule.moves, n, where);
+	}
+
+	//give every state of def a place in the table, inlining the machines it calls
+	void addFrame(const MachineDef &def, const string &prefix, const vector<int> &tape_map, int label, int parent,
+		const string &ret_moves, const string &ret_next, int depth, vector<TableFrame> &frames, Machine &m,
+		vector<int> &state_frames, vector<const TableStateDef *> &state_defs, map<string, int> &ids,
+		map<string, string> &aliases, map<string, int> &label_ids) const {
+		if (depth > 16)
+			throw runtime_error(def.source + ": machine " + def.name + ": calls nest too deep (is a call recursive?)");
+		if (!frames.empty() && (def.symbols != frames[0].def->symbols || def.blank != frames[0].def->blank))
+			throw runtime_error(def.source + ": machine " + def.name + ": called machines need the same symbols");
+		TableFrame frame = {&def, prefix, tape_map, label, parent, ret_moves, ret_next};
+		int f = frames.size();
+		frames.push_back(frame);
+		for (size_t s = 0; s < def.states.size(); s++) {
+			const TableStateDef &sd = def.states[s];
+			string where = def.source + ":" + to_string(sd.line) + ": ";
+			int state_label = label;
+			if (state_label < 0) {
+				const string &name = sd.label.empty() ? sd.name : sd.label;
+				if (!label_ids.count(name)) {
+					label_ids[name] = m.label_names.size();
+					m.label_names.push_back(name);
+				}
+				state_label = label_ids[name];
+			}
+			if (sd.callee.empty()) {
+				if (ids.count(prefix + sd.name) || aliases.count(prefix + sd.name))
+					throw runtime_error(where + "state " + sd.name + " is defined twice");
+				ids[prefix + sd.name] = m.state_names.size();
+				m.state_names.push_back(prefix + sd.name);
+				m.labels.push_back(state_label);
+				state_frames.push_back(f);
+				state_defs.push_back(&sd);
+				continue;
+			}
+			const MachineDef &callee = find(sd.callee, where);
+			if (sd.call_tapes.size() != callee.tapes.size())
+				throw runtime_error(where + "machine " + callee.name + " needs " + to_string(callee.tapes.size()) + " tapes");
+			checkMoves(sd.ret_moves, def.tapes.size(), where);
+			vector<int> callee_map;
+			for (size_t i = 0; i < sd.call_tapes.size(); i++)
+				callee_map.push_back(tape_map[tapeIndex(def, sd.call_tapes[i], where)]);
+			string callee_prefix = prefix + sd.name + "/";
+			aliases[prefix + sd.name] = callee_prefix + (sd.entry.empty() ? callee.start : sd.entry);
+			addFrame(callee, callee_prefix, callee_map, state_label, f, sd.ret_moves, sd.ret_next, depth + 1, frames, m,
+				state_frames, state_defs, ids, aliases, label_ids);
+		}
+	}
+
+	static int resolve(string name, const map<string, int> &ids, const map<string, string> &aliases, const string &where) {
+		for (map<string, string>::const_iterator it; (it = aliases.find(name)) != aliases.end(); )
+			name = it->second;
+		map<string, int>::const_iterator it = ids.find(name);
+		if (it == ids.end())
+			throw runtime_error(where + "no state named \'" + name + "\'");
+		return it->second;
+	}
+
+	//mark the states whose runs can be done with a single search
+	static void findScans(Machine &m, const string &syms) {
+		m.scans.resize(m.state_names.size());
+		for (size_t s = 0; s < m.state_names.size(); s++) {
+			TableScan &scan = m.scans[s];
+			scan.tape = -1;
+			for (int t = 0; t < m.ntapes && scan.tape < 0; t++) {
+				for (int dir = -1; dir <= 1 && scan.tape < 0; dir += 2) {
+					int stop = -1;
+					for (int c = 0; c < m.combos && stop != -2; c++) {
+						const TableTransition &tr = m.table[s * m.combos + c];
+						bool loops = tr.next == (int)s && !tr.extend;
+						for (int u = 0; u < m.ntapes; u++)
+							loops = loops && !(tr.writes >> u & 1) && tr.move[u] == (u == t ? dir : 0);
+						int sym = c / m.place[t] % syms.size();
+						if (!loops)
+							stop = stop == -1 || stop == sym ? sym : -2;
+					}
+					if (stop >= 0) {
+						scan.tape = t;
+						scan.dir = dir;
+						scan.stop = syms[stop];
+					}
+				}
+			}
+		}
+	}
+};
+
+//the machines "-add", "-mult" and "-exp" run, as table descriptions
+const char *BUILTIN_MACHINES = R"TM(
+machine add
+tapes Add
+symbols 0 1 B
+blank B
+input Add B{x}B{y}B
+start Start
+trace steps
+header Trace for {x} + {y}\n\n
+result Add 0
+
+state Start
+	* -> * R TakeOneX
+
+# subtract one from x, or halt once x is all zeros
+state TakeOneX
+	0 -> 1 R TakeOneX
+	1 -> 0 S AddOneX
+	B -> * S Halt
+
+state AddOneX
+	B -> * R AddOneY
+	* -> * R AddOneX
+
+# add one to y, growing it at its end if needed
+state AddOneY
+	1 -> 0 R AddOneY
+	0 -> 1 L GetNextY
+	B -> 1 L GetNextY extend
+
+state GetNextY
+	B -> * L GetNextX
+	* -> * L GetNextY
+
+state GetNextX
+	B -> * R TakeOneX
+	* -> * L GetNextX
+
+machine mult
+tapes Mult Add
+symbols 0 1 B
+blank B
+input Mult B{x}B{y}B0B
+input Add B
+start Start
+trace transitions Add Mult
+header Abbreviated Trace for {x} x {y}\n\n
+result Mult 0
+
+state Start
+	** -> ** RR TakeOneInX
+
+# subtract one from x, or move to the result once x is all zeros
+state TakeOneInX
+	0* -> 1* RS TakeOneInX
+	1* -> 0* SS MoveToYFromX
+	B* -> ** RS MoveToOutputFromY
+
+state MoveToOutputFromY
+	B* -> ** SS Halt
+	** -> ** RS MoveToOutputFromY
+
+state MoveToYFromX
+	B* -> ** RS WriteFirstAddArg
+	** -> ** RS MoveToYFromX
+
+# copy y and then the result so far to the add tape
+state WriteFirstAddArg
+	B* -> *B RR WriteSecondAddArg
+	** -> *a RR WriteFirstAddArg
+
+state WriteSecondAddArg
+	B* -> *B LL MoveToBeginAdd
+	** -> *a RR WriteSecondAddArg
+
+state MoveToBeginAdd
+	*B -> ** SL MoveToBeginAdd.X
+	** -> ** SL MoveToBeginAdd
+
+state MoveToBeginAdd.X label MoveToBeginAdd
+	*B -> ** SR Add*
+	** -> ** SL MoveToBeginAdd.X
+
+state Add* call add
+	tapes Add
+	entry TakeOneX
+	return SR MoveToOutputStartFromEnd
+
+state MoveToOutputStartFromEnd
+	B* -> ** RS WriteSumBack
+	** -> ** LS MoveToOutputStartFromEnd
+
+# copy the sum back over the result
+state WriteSumBack
+	*B -> B* LL FirstCellFromEndAddTape*
+	** -> b* RR WriteSumBack
+
+state FirstCellFromEndAddTape*
+	*B -> ** SL FirstCellFromEndAddTape*.X
+	** -> ** SL FirstCellFromEndAddTape*
+
+state FirstCellFromEndAddTape*.X label FirstCellFromEndAddTape*
+	*B -> ** SR FirstCellFromEndMultTape*
+	** -> ** SL FirstCellFromEndAddTape*.X
+
+state FirstCellFromEndMultTape*
+	B* -> ** LS FirstCellFromEndMultTape*.Y
+	** -> ** LS FirstCellFromEndMultTape*
+
+state FirstCellFromEndMultTape*.Y label FirstCellFromEndMultTape*
+	B* -> ** LS FirstCellFromEndMultTape*.X
+	** -> ** LS FirstCellFromEndMultTape*.Y
+
+state FirstCellFromEndMultTape*.X label FirstCellFromEndMultTape*
+	B* -> ** RS TakeOneInX
+	** -> ** LS FirstCellFromEndMultTape*.X
+
+machine exp
+tapes Exp Mult Add
+symbols 0 1 B
+blank B
+input Exp B{x}B{y}B1B
+input Mult B
+input Add B
+start Start
+trace transitions Mult Exp
+header Abbreviated Trace for {x} ^ {y} (x to the yth power)\n\n
+result Exp -1
+
+state Start
+	*** -> *** RRR MoveToYFromXForDecrement
+
+state MoveToYFromXForDecrement
+	B** -> *** RSS DecrementY
+	*** -> *** RSS MoveToYFromXForDecrement
+
+# subtract one from y, or halt on the result once y is all zeros
+state DecrementY
+	0** -> 1** RSS DecrementY
+	1** -> 0** SSS MoveToResFromY
+	B** -> *** RSS Halt
+
+state MoveToResFromY
+	B** -> *** RSS WriteResAsMultArg
+	*** -> *** RSS MoveToResFromY
+
+# copy the result so far and then x to the mult tape, followed by a product of 0
+state WriteResAsMultArg
+	B** -> *B* LRS MoveToYForXWrite
+	*** -> *a* RRS WriteResAsMultArg
+
+state MoveToYForXWrite
+	B** -> *** LSS MoveToXForXWrite
+	*** -> *** LSS MoveToYForXWrite
+
+state MoveToXForXWrite
+	B** -> *** LSS MoveToXBeginFromXEndForXWrite
+	*** -> *** LSS MoveToXForXWrite
+
+state MoveToXBeginFromXEndForXWrite
+	B** -> *** RSS WriteXAsMultArg
+	*** -> *** LSS MoveToXBeginFromXEndForXWrite
+
+state WriteXAsMultArg
+	B** -> *B* RRS InitMultRes
+	*** -> *a* RRS WriteXAsMultArg
+
+state InitMultRes
+	*** -> *0* SRS MakeLastBlankInMult
+
+state MakeLastBlankInMult
+	*** -> *B* SLS MultMoveToYAfterInitResWrite
+
+state MultMoveToYAfterInitResWrite
+	*B* -> *** SLS ToFirstInputEndInMultAfterXWrite
+	*** -> *** SLS MultMoveToYAfterInitResWrite
+
+state ToFirstInputEndInMultAfterXWrite
+	*B* -> *** SLS ToFirstInputBeginInMultAfterArgWrites
+	*** -> *** SLS ToFirstInputEndInMultAfterXWrite
+
+state ToFirstInputBeginInMultAfterArgWrites
+	*B* -> *** SRS Mult*
+	*** -> *** SLS ToFirstInputBeginInMultAfterArgWrites
+
+state Mult* call mult
+	tapes Mult Add
+	entry TakeOneInX
+	return SRS ToExpResultForUpdate
+
+state ToExpResultForUpdate
+	B** -> *** RSS WriteProduct
+	*** -> *** RSS ToExpResultForUpdate
+
+# copy the product back over the result
+state WriteProduct
+	*B* -> B** LLS FirstCellFromEndExpTape*
+	*** -> b** RRS WriteProduct
+
+state FirstCellFromEndExpTape*
+	B** -> *** LSS FirstCellFromEndExpTape*.Y
+	*** -> *** LSS FirstCellFromEndExpTape*
+
+state FirstCellFromEndExpTape*.Y label FirstCellFromEndExpTape*
+	B** -> *** LSS FirstCellFromEndExpTape*.X
+	*** -> *** LSS FirstCellFromEndExpTape*.Y
+
+state FirstCellFromEndExpTape*.X label FirstCellFromEndExpTape*
+	B** -> *** RSS FirstCellFromEndMultTape*
+	*** -> *** LSS FirstCellFromEndExpTape*.X
+
+state FirstCellFromEndMultTape*
+	*B* -> *** SLS FirstCellFromEndMultTape*.Y
+	*** -> *** SLS FirstCellFromEndMultTape*
+
+state FirstCellFromEndMultTape*.Y label FirstCellFromEndMultTape*
+	*B* -> *** SLS FirstCellFromEndMultTape*.X
+	*** -> *** SLS FirstCellFromEndMultTape*.Y
+
+state FirstCellFromEndMultTape*.X label FirstCellFromEndMultTape*
+	*B* -> *** SRS MoveToYFromXForDecrement
+	*** -> *** SLS FirstCellFromEndMultTape*.X
+)TM";
+
+//replace {x} and {y} in a description's text with the inputs
+string fillInputs(const string &text, const string &x, const string &y) {
+	string res;
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text.compare(i, 3, "{x}") == 0 || text.compare(i, 3, "{y}") == 0) {
+			res += text[i + 1] == 'x' ? x : y;
+			i += 2;
+		}
+		else
+			res += text[i];
+	}
+	return res;
+}
+
+//trace a machine entering the state with the given label, using the tapes and trace style of its description
+void traceMachine(const Machine &m, const char *label, bool halted, const vector<vector<char> > &tapes,
+	const TapeIdx *heads, Tracer &trace, bool initial) {
+	if (m.trace_steps) {
+		int t = m.traced[0];
+		if (initial)
+			trace.start(label, heads[t]);
+		else if (halted)
+			trace.halt(heads[t], view(tapes[t]));
+		else
+			trace.step(label, heads[t], view(tapes[t]));
+		return;
+	}
+	TracedTape traced[MAX_TAPES];
+	for (size_t i = 0; i < m.traced.size(); i++) {
+		int t = m.traced[i];
+		TracedTape tt = {m.tape_names[t].c_str(), heads[t], view(tapes[t])};
+		traced[i] = tt;
+	}
+	trace.config(halted ? "Halt" : label, traced, m.traced.size(), initial);
+}
+
+//trace a table machine as it enters state, which is TABLE_HALT once it halts
+void traceTable(const Machine &m, int state, const vector<vector<char> > &tapes, const TapeIdx *heads, Tracer &trace,
+	bool initial) {
+	bool halted = state == TABLE_HALT;
+	traceMachine(m, halted ? "Halt" : m.label_names[m.labels[state]].c_str(), halted, tapes, heads, trace, initial);
+}
+
+//the error for a table machine that has no rule for what it reads or moves off a tape, kept out of runTable's loop
+__attribute__((noinline)) void tableError(const Machine &m, int state, int tape) {
+	if (tape < 0)
+		throw runtime_error("machine " + m.name + " has no rule for the symbols read in state " + m.state_names[state]);
+	throw runtime_error("machine " + m.name + " moved off the left end of tape " + m.tape_names[tape]);
+}
+
+//store a write at the end of a table machine's tape, which is rare enough to keep out of runTable's loop
+__attribute__((noinline)) void growTape(vector<char> &tape, char write, TapeIdx idx, bool extend, char blank) {
+	writeSafe(tape, write, idx);
+	if (extend)
+		writeSafe(tape, blank, idx + 1);
+}
+
+/* run a table machine with K tapes until it halts. Everything the loop uses is copied into locals and tapes are only
+ * indexed by constants, so that it can all stay in registers; writing a cell through a char pointer would otherwise
+ * make the compiler reload anything it can't prove isn't written
+ */
+template <int K>
+void runTable(const Machine &m, vector<vector<char> > &tapes, TapeIdx *heads, Tracer &trace, SimContext &ctx) {
+	char *cells[K];
+	TapeIdx len[K], head[K];
+	//how much each symbol under each head adds to a state's table index
+	int offset[K][256];
+	for (int t = 0; t < K; t++) {
+		cells[t] = tapes[t].data();
+		len[t] = tapes[t].size();
+		head[t] = heads[t];
+		for (int c = 0; c < 256; c++)
+			offset[t][c] = max(m.code[c], 0) * m.place[t];
 	}
-	if (res.size() == 0) {
-		res.push_back('0');
+	const TableTransition *table = m.table.data();
+	const TableScan *scans = m.scans.data();
+	const int *labels = m.labels.data();
+	const size_t combos = m.combos;
+	const char blank = m.blank;
+	const bool scan = ctx.accelerate && !m.trace_steps;
+	const bool trace_steps = m.trace_steps;
+	unsigned long long steps = ctx.steps;
+	int state = m.start;
+	while (1) {
+		if (scan && scans[state].tape >= 0) {
+			const TableScan run = scans[state];
+#pragma GCC unroll 4
+			for (int t = 0; t < K; t++) {
+				if (t != run.tape)
+					continue;
+				long long h = head[t], to, end = len[t];
+				if (h >= end)
+					to = run.stop == blank ? h : -1;
+				else if (run.dir > 0) {
+					to = findCellRight(cells[t], h, end, run.stop);
+					if (to == end && run.stop != blank)
+						to = -1;
+				}
+				else
+					to = findCellLeft(cells[t], h, run.stop);
+				//with no stop symbol to find, step normally until the machine goes off the tape
+				if (to >= 0) {
+					steps += run.dir > 0 ? to - h : h - to;
+					head[t] = to;
+				}
+			}
+		}
+
+		size_t idx = state * combos;
+#pragma GCC unroll 4
+		for (int t = 0; t < K; t++)
+			idx += offset[t][(unsigned char)(head[t] < len[t] ? cells[t][head[t]] : blank)];
+		const TableTransition &tr = table[idx];
+		if (tr.next == TABLE_UNDEFINED)
+			tableError(m, state, -1);
+#pragma GCC unroll 4
+		for (int t = 0; t < K; t++) {
+			if (head[t] + tr.extend < len[t]) {
+				cells[t][head[t]] = tr.write[t];
+				if (tr.extend && (tr.writes >> t & 1))
+					cells[t][head[t] + 1] = blank;
+			}
+			else if (tr.writes >> t & 1) {
+				growTape(tapes[t], tr.write[t], head[t], tr.extend, blank);
+				cells[t] = tapes[t].data();
+				len[t] = tapes[t].size();
+			}
+			head[t] += tr.move[t];
+			if (head[t] < 0)
+				tableError(m, state, t);
+		}
+		steps++;
+
+		/* most steps stay in the same state; testing for that first lets the processor go on with the state it
+		 * already has rather than wait for the transition to be loaded
+		 */
+		if (tr.next == state && !trace_steps)
+			continue;
+		int next = tr.next;
+		if (next == TABLE_HALT || trace_steps || labels[next] != labels[state]) {
+			copy(head, head + K, heads);
+			//the step count is kept in a local, but the trace index reads it from ctx
+			ctx.steps = steps;
+			traceTable(m, next, tapes, heads, trace, false);
+		}
+		if (next == TABLE_HALT)
+			break;
+		state = next;
 	}
+	ctx.steps = steps;
+}
+
+//set up a machine's tapes for inputs x and y as its description says, and trace its start
+void startMachine(const Machine &m, const BigNum &x, const BigNum &y, vector<vector<char> > &tapes, TapeIdx *heads,
+	Tracer &trace) {
+	vector<char> bin_x = binVector(x);
+	vector<char> bin_y = binVector(y);
+	string str_x(bin_x.begin(), bin_x.end());
+	string str_y(bin_y.begin(), bin_y.end());
+	tapes.assign(m.ntapes, vector<char>());
+	fill(heads, heads + MAX_TAPES, 0);
+	for (int t = 0; t < m.ntapes; t++) {
+		string cells = fillInputs(m.inputs[t], str_x, str_y);
+		tapes[t].assign(cells.begin(), cells.end());
+		for (size_t i = 0; i < cells.size(); i++)
+			if (m.code[(unsigned char)cells[i]] < 0)
+				throw runtime_error("input for tape " + m.tape_names[t] + " of machine " + m.name + " has a symbol it doesn't use");
+	}
+	trace.text(fillInputs(m.header, x.toString(), y.toString()));
+	traceTable(m, m.start, tapes, heads, trace, true);
+}
+
+//the tape with a halted machine's result, starting with the blank just before the result
+vector<char> machineResult(const Machine &m, vector<vector<char> > &tapes, const TapeIdx *heads) {
+	vector<char> &res = tapes[m.result_tape];
+	TapeIdx from = heads[m.result_tape] + m.result_offset;
+	if (from > 0)
+		eraseFront(res, min((size_t)from, res.size()));
 	return res;
 }
 
-//convert a vector of '0' and '1' chars to a corresponding int
-unsigned int vecToInt(vector<char> vec) {
-	if (vec.size() > 32)
-		vec.resize(32);
-	reverse(begin(vec), end(vec));
-	string istr(vec.begin(), vec.end());
-	size_t *nptr = NULL;
-	return (unsigned int)std::stoul(istr, nptr, 2);
+//run a table machine on inputs x and y, returning the tape with its result
+vector<char> runMachine(const Machine &m, const BigNum &x, const BigNum &y, Tracer &trace, SimContext &ctx) {
+	vector<vector<char> > tapes;
+	TapeIdx heads[MAX_TAPES];
+	startMachine(m, x, y, tapes, heads, trace);
+	switch (m.ntapes) {
+	case 1:
+		runTable<1>(m, tapes, heads, trace, ctx);
+		break;
+	case 2:
+		runTable<2>(m, tapes, heads, trace, ctx);
+		break;
+	case 3:
+		runTable<3>(m, tapes, heads, trace, ctx);
+		break;
+	default:
+		runTable<MAX_TAPES>(m, tapes, heads, trace, ctx);
+		break;
+	}
+	return machineResult(m, tapes, heads);
 }
 
-//write to the tape at an index, even if the tape hasn't reached that size before
-void writeSafe(vector<char> &tape, char write, int idx) {
-	if (idx >= (int)tape.size())
-		tape.resize(idx + 1, 'B');
-	tape[idx] = write;
+/* Machines compiled into the program: each one's rules are constexpr data in the same form as a description, and
+ * templates turn every state into its own loop with the transitions for what it reads worked out at compile time.
+ * A state only looks at the tapes whose symbols change what it does, and its moves and writes are constants, so
+ * a step is a few loads, stores and one jump rather than a lookup in a table. The tapes, inputs and trace style
+ * come from the machine's description in BUILTIN_MACHINES. Unlike descriptions, the symbols are always 0, 1 and B.
+ */
+const int FIXED_HALT = -1;
+const int FIXED_UNDEFINED = -2;
+
+//a rule of a compiled in machine; states are numbered within the machine, and next is FIXED_HALT to halt
+struct FixedRule {
+	int state;
+	const char *reads;
+	const char *writes;
+	const char *moves;
+	int next;
+	bool extend;
+};
+
+/* rules placed among the states of a machine: the machine's own, or those of a machine it calls. tapes has the
+ * machine's tape number for each of the rules' tapes. A called machine's halting transitions make ret_moves (one
+ * for each of the machine's tapes) and go to state ret_next, and all of its states are traced as label
+ */
+struct FixedPart {
+	const FixedRule *rules;
+	int count;
+	int offset;
+	const char *tapes;
+	const char *const *names;
+	const char *label;
+	const char *ret_moves;
+	int ret_next;
+};
+
+enum AddState {
+	ADD_START, ADD_TAKE_ONE_X, ADD_ADD_ONE_X, ADD_ADD_ONE_Y, ADD_GET_NEXT_Y, ADD_GET_NEXT_X, ADD_STATES
+};
+
+constexpr const char *ADD_NAMES[] = {"Start", "TakeOneX", "AddOneX", "AddOneY", "GetNextY", "GetNextX"};
+
+constexpr FixedRule ADD_RULES[] = {
+	{ADD_START, "*", "*", "R", ADD_TAKE_ONE_X, false},
+	{ADD_TAKE_ONE_X, "0", "1", "R", ADD_TAKE_ONE_X, false},
+	{ADD_TAKE_ONE_X, "1", "0", "S", ADD_ADD_ONE_X, false},
+	{ADD_TAKE_ONE_X, "B", "*", "S", FIXED_HALT, false},
+	{ADD_ADD_ONE_X, "B", "*", "R", ADD_ADD_ONE_Y, false},
+	{ADD_ADD_ONE_X, "*", "*", "R", ADD_ADD_ONE_X, false},
+	{ADD_ADD_ONE_Y, "1", "0", "R", ADD_ADD_ONE_Y, false},
+	{ADD_ADD_ONE_Y, "0", "1", "L", ADD_GET_NEXT_Y, false},
+	{ADD_ADD_ONE_Y, "B", "1", "L", ADD_GET_NEXT_Y, true},
+	{ADD_GET_NEXT_Y, "B", "*", "L", ADD_GET_NEXT_X, false},
+	{ADD_GET_NEXT_Y, "*", "*", "L", ADD_GET_NEXT_Y, false},
+	{ADD_GET_NEXT_X, "B", "*", "R", ADD_TAKE_ONE_X, false},
+	{ADD_GET_NEXT_X, "*", "*", "L", ADD_GET_NEXT_X, false},
+};
+
+//mult's states, followed by those of the add machine it calls
+enum MultState {
+	MULT_START, MULT_TAKE_ONE_IN_X, MULT_MOVE_TO_OUTPUT_FROM_Y, MULT_MOVE_TO_Y_FROM_X, MULT_WRITE_FIRST_ADD_ARG,
+	MULT_WRITE_SECOND_ADD_ARG, MULT_MOVE_TO_BEGIN_ADD, MULT_MOVE_TO_BEGIN_ADD_X, MULT_MOVE_TO_OUTPUT_START_FROM_END,
+	MULT_WRITE_SUM_BACK, MULT_FIRST_CELL_ADD, MULT_FIRST_CELL_ADD_X, MULT_FIRST_CELL_MULT, MULT_FIRST_CELL_MULT_Y,
+	MULT_FIRST_CELL_MULT_X, MULT_OWN_STATES, MULT_ADD = MULT_OWN_STATES, MULT_STATES = MULT_ADD + ADD_STATES
+};
+
+constexpr const char *MULT_NAMES[] = {
+	"Start", "TakeOneInX", "MoveToOutputFromY", "MoveToYFromX", "WriteFirstAddArg", "WriteSecondAddArg",
+	"MoveToBeginAdd", "MoveToBeginAdd", "MoveToOutputStartFromEnd", "WriteSumBack", "FirstCellFromEndAddTape*",
+	"FirstCellFromEndAddTape*", "FirstCellFromEndMultTape*", "FirstCellFromEndMultTape*", "FirstCellFromEndMultTape*"
+};
+
+//the tapes are Mult then Add
+constexpr FixedRule MULT_RULES[] = {
+	{MULT_START, "**", "**", "RR", MULT_TAKE_ONE_IN_X, false},
+	{MULT_TAKE_ONE_IN_X, "0*", "1*", "RS", MULT_TAKE_ONE_IN_X, false},
+	{MULT_TAKE_ONE_IN_X, "1*", "0*", "SS", MULT_MOVE_TO_Y_FROM_X, false},
+	{MULT_TAKE_ONE_IN_X, "B*", "**", "RS", MULT_MOVE_TO_OUTPUT_FROM_Y, false},
+	{MULT_MOVE_TO_OUTPUT_FROM_Y, "B*", "**", "SS", FIXED_HALT, false},
+	{MULT_MOVE_TO_OUTPUT_FROM_Y, "**", "**", "RS", MULT_MOVE_TO_OUTPUT_FROM_Y, false},
+	{MULT_MOVE_TO_Y_FROM_X, "B*", "**", "RS", MULT_WRITE_FIRST_ADD_ARG, false},
+	{MULT_MOVE_TO_Y_FROM_X, "**", "**", "RS", MULT_MOVE_TO_Y_FROM_X, false},
+	{MULT_WRITE_FIRST_ADD_ARG, "B*", "*B", "RR", MULT_WRITE_SECOND_ADD_ARG, false},
+	{MULT_WRITE_FIRST_ADD_ARG, "**", "*a", "RR", MULT_WRITE_FIRST_ADD_ARG, false},
+	{MULT_WRITE_SECOND_ADD_ARG, "B*", "*B", "LL", MULT_MOVE_TO_BEGIN_ADD, false},
+	{MULT_WRITE_SECOND_ADD_ARG, "**", "*a", "RR", MULT_WRITE_SECOND_ADD_ARG, false},
+	{MULT_MOVE_TO_BEGIN_ADD, "*B", "**", "SL", MULT_MOVE_TO_BEGIN_ADD_X, false},
+	{MULT_MOVE_TO_BEGIN_ADD, "**", "**", "SL", MULT_MOVE_TO_BEGIN_ADD, false},
+	{MULT_MOVE_TO_BEGIN_ADD_X, "*B", "**", "SR", MULT_ADD + ADD_TAKE_ONE_X, false},
+	{MULT_MOVE_TO_BEGIN_ADD_X, "**", "**", "SL", MULT_MOVE_TO_BEGIN_ADD_X, false},
+	{MULT_MOVE_TO_OUTPUT_START_FROM_END, "B*", "**", "RS", MULT_WRITE_SUM_BACK, false},
+	{MULT_MOVE_TO_OUTPUT_START_FROM_END, "**", "**", "LS", MULT_MOVE_TO_OUTPUT_START_FROM_END, false},
+	{MULT_WRITE_SUM_BACK, "*B", "B*", "LL", MULT_FIRST_CELL_ADD, false},
+	{MULT_WRITE_SUM_BACK, "**", "b*", "RR", MULT_WRITE_SUM_BACK, false},
+	{MULT_FIRST_CELL_ADD, "*B", "**", "SL", MULT_FIRST_CELL_ADD_X, false},
+	{MULT_FIRST_CELL_ADD, "**", "**", "SL", MULT_FIRST_CELL_ADD, false},
+	{MULT_FIRST_CELL_ADD_X, "*B", "**", "SR", MULT_FIRST_CELL_MULT, false},
+	{MULT_FIRST_CELL_ADD_X, "**", "**", "SL", MULT_FIRST_CELL_ADD_X, false},
+	{MULT_FIRST_CELL_MULT, "B*", "**", "LS", MULT_FIRST_CELL_MULT_Y, false},
+	{MULT_FIRST_CELL_MULT, "**", "**", "LS", MULT_FIRST_CELL_MULT, false},
+	{MULT_FIRST_CELL_MULT_Y, "B*", "**", "LS", MULT_FIRST_CELL_MULT_X, false},
+	{MULT_FIRST_CELL_MULT_Y, "**", "**", "LS", MULT_FIRST_CELL_MULT_Y, false},
+	{MULT_FIRST_CELL_MULT_X, "B*", "**", "RS", MULT_TAKE_ONE_IN_X, false},
+	{MULT_FIRST_CELL_MULT_X, "**", "**", "LS", MULT_FIRST_CELL_MULT_X, false},
+};
+
+//exp's states, followed by those of the mult machine it calls (which are followed by add's)
+enum ExpState {
+	EXP_START, EXP_MOVE_TO_Y_FROM_X_FOR_DECREMENT, EXP_DECREMENT_Y, EXP_MOVE_TO_RES_FROM_Y, EXP_WRITE_RES_AS_MULT_ARG,
+	EXP_MOVE_TO_Y_FOR_X_WRITE, EXP_MOVE_TO_X_FOR_X_WRITE, EXP_MOVE_TO_X_BEGIN_FOR_X_WRITE, EXP_WRITE_X_AS_MULT_ARG,
+	EXP_INIT_MULT_RES, EXP_MAKE_LAST_BLANK_IN_MULT, EXP_MULT_MOVE_TO_Y, EXP_TO_FIRST_INPUT_END_IN_MULT,
+	EXP_TO_FIRST_INPUT_BEGIN_IN_MULT, EXP_TO_EXP_RESULT_FOR_UPDATE, EXP_WRITE_PRODUCT, EXP_FIRST_CELL_EXP,
+	EXP_FIRST_CELL_EXP_Y, EXP_FIRST_CELL_EXP_X, EXP_FIRST_CELL_MULT, EXP_FIRST_CELL_MULT_Y, EXP_FIRST_CELL_MULT_X,
+	EXP_OWN_STATES, EXP_MULT = EXP_OWN_STATES, EXP_STATES = EXP_MULT + MULT_STATES
+};
+
+constexpr const char *EXP_NAMES[] = {
+	"Start", "MoveToYFromXForDecrement", "DecrementY", "MoveToResFromY", "WriteResAsMultArg", "MoveToYForXWrite",
+	"MoveToXForXWrite", "MoveToXBeginFromXEndForXWrite", "WriteXAsMultArg", "InitMultRes", "MakeLastBlankInMult",
+	"MultMoveToYAfterInitResWrite", "ToFirstInputEndInMultAfterXWrite", "ToFirstInputBeginInMultAfterArgWrites",
+	"ToExpResultForUpdate", "WriteProduct", "FirstCellFromEndExpTape*", "FirstCellFromEndExpTape*",
+	"FirstCellFromEndExpTape*", "FirstCellFromEndMultTape*", "FirstCellFromEndMultTape*", "FirstCellFromEndMultTape*"
+};
+
+//the tapes are Exp, Mult then Add
+constexpr FixedRule EXP_RULES[] = {
+	{EXP_START, "***", "***", "RRR", EXP_MOVE_TO_Y_FROM_X_FOR_DECREMENT, false},
+	{EXP_MOVE_TO_Y_FROM_X_FOR_DECREMENT, "B**", "***", "RSS", EXP_DECREMENT_Y, false},
+	{EXP_MOVE_TO_Y_FROM_X_FOR_DECREMENT, "***", "***", "RSS", EXP_MOVE_TO_Y_FROM_X_FOR_DECREMENT, false},
+	{EXP_DECREMENT_Y, "0**", "1**", "RSS", EXP_DECREMENT_Y, false},
+	{EXP_DECREMENT_Y, "1**", "0**", "SSS", EXP_MOVE_TO_RES_FROM_Y, false},
+	{EXP_DECREMENT_Y, "B**", "***", "RSS", FIXED_HALT, false},
+	{EXP_MOVE_TO_RES_FROM_Y, "B**", "***", "RSS", EXP_WRITE_RES_AS_MULT_ARG, false},
+	{EXP_MOVE_TO_RES_FROM_Y, "***", "***", "RSS", EXP_MOVE_TO_RES_FROM_Y, false},
+	{EXP_WRITE_RES_AS_MULT_ARG, "B**", "*B*", "LRS", EXP_MOVE_TO_Y_FOR_X_WRITE, false},
+	{EXP_WRITE_RES_AS_MULT_ARG, "***", "*a*", "RRS", EXP_WRITE_RES_AS_MULT_ARG, false},
+	{EXP_MOVE_TO_Y_FOR_X_WRITE, "B**", "***", "LSS", EXP_MOVE_TO_X_FOR_X_WRITE, false},
+	{EXP_MOVE_TO_Y_FOR_X_WRITE, "***", "***", "LSS", EXP_MOVE_TO_Y_FOR_X_WRITE, false},
+	{EXP_MOVE_TO_X_FOR_X_WRITE, "B**", "***", "LSS", EXP_MOVE_TO_X_BEGIN_FOR_X_WRITE, false},
+	{EXP_MOVE_TO_X_FOR_X_WRITE, "***", "***", "LSS", EXP_MOVE_TO_X_FOR_X_WRITE, false},
+	{EXP_MOVE_TO_X_BEGIN_FOR_X_WRITE, "B**", "***", "RSS", EXP_WRITE_X_AS_MULT_ARG, false},
+	{EXP_MOVE_TO_X_BEGIN_FOR_X_WRITE, "***", "***", "LSS", EXP_MOVE_TO_X_BEGIN_FOR_X_WRITE, false},
+	{EXP_WRITE_X_AS_MULT_ARG, "B**", "*B*", "RRS", EXP_INIT_MULT_RES, false},
+	{EXP_WRITE_X_AS_MULT_ARG, "***", "*a*", "RRS", EXP_WRITE_X_AS_MULT_ARG, false},
+	{EXP_INIT_MULT_RES, "***", "*0*", "SRS", EXP_MAKE_LAST_BLANK_IN_MULT, false},
+	{EXP_MAKE_LAST_BLANK_IN_MULT, "***", "*B*", "SLS", EXP_MULT_MOVE_TO_Y, false},
+	{EXP_MULT_MOVE_TO_Y, "*B*", "***", "SLS", EXP_TO_FIRST_INPUT_END_IN_MULT, false},
+	{EXP_MULT_MOVE_TO_Y, "***", "***", "SLS", EXP_MULT_MOVE_TO_Y, false},
+	{EXP_TO_FIRST_INPUT_END_IN_MULT, "*B*", "***", "SLS", EXP_TO_FIRST_INPUT_BEGIN_IN_MULT, false},
+	{EXP_TO_FIRST_INPUT_END_IN_MULT, "***", "***", "SLS", EXP_TO_FIRST_INPUT_END_IN_MULT, false},
+	{EXP_TO_FIRST_INPUT_BEGIN_IN_MULT, "*B*", "***", "SRS", EXP_MULT + MULT_TAKE_ONE_IN_X, false},
+	{EXP_TO_FIRST_INPUT_BEGIN_IN_MULT, "***", "***", "SLS", EXP_TO_FIRST_INPUT_BEGIN_IN_MULT, false},
+	{EXP_TO_EXP_RESULT_FOR_UPDATE, "B**", "***", "RSS", EXP_WRITE_PRODUCT, false},
+	{EXP_TO_EXP_RESULT_FOR_UPDATE, "***", "***", "RSS", EXP_TO_EXP_RESULT_FOR_UPDATE, false},
+	{EXP_WRITE_PRODUCT, "*B*", "B**", "LLS", EXP_FIRST_CELL_EXP, false},
+	{EXP_WRITE_PRODUCT, "***", "b**", "RRS", EXP_WRITE_PRODUCT, false},
+	{EXP_FIRST_CELL_EXP, "B**", "***", "LSS", EXP_FIRST_CELL_EXP_Y, false},
+	{EXP_FIRST_CELL_EXP, "***", "***", "LSS", EXP_FIRST_CELL_EXP, false},
+	{EXP_FIRST_CELL_EXP_Y, "B**", "***", "LSS", EXP_FIRST_CELL_EXP_X, false},
+	{EXP_FIRST_CELL_EXP_Y, "***", "***", "LSS", EXP_FIRST_CELL_EXP_Y, false},
+	{EXP_FIRST_CELL_EXP_X, "B**", "***", "RSS", EXP_FIRST_CELL_MULT, false},
+	{EXP_FIRST_CELL_EXP_X, "***", "***", "LSS", EXP_FIRST_CELL_EXP_X, false},
+	{EXP_FIRST_CELL_MULT, "*B*", "***", "SLS", EXP_FIRST_CELL_MULT_Y, false},
+	{EXP_FIRST_CELL_MULT, "***", "***", "SLS", EXP_FIRST_CELL_MULT, false},
+	{EXP_FIRST_CELL_MULT_Y, "*B*", "***", "SLS", EXP_FIRST_CELL_MULT_X, false},
+	{EXP_FIRST_CELL_MULT_Y, "***", "***", "SLS", EXP_FIRST_CELL_MULT_Y, false},
+	{EXP_FIRST_CELL_MULT_X, "*B*", "***", "SRS", EXP_MOVE_TO_Y_FROM_X_FOR_DECREMENT, false},
+	{EXP_FIRST_CELL_MULT_X, "***", "***", "SLS", EXP_FIRST_CELL_MULT_X, false},
+};
+
+#define FIXED_RULE_COUNT(rules) (int)(sizeof(rules) / sizeof(FixedRule))
+
+constexpr FixedPart ADD_PARTS[] = {
+	{ADD_RULES, FIXED_RULE_COUNT(ADD_RULES), 0, "0", ADD_NAMES, NULL, "", 0},
+};
+
+constexpr FixedPart MULT_PARTS[] = {
+	{MULT_RULES, FIXED_RULE_COUNT(MULT_RULES), 0, "01", MULT_NAMES, NULL, "", 0},
+	{ADD_RULES, FIXED_RULE_COUNT(ADD_RULES), MULT_ADD, "1", NULL, "Add*", "SR", MULT_MOVE_TO_OUTPUT_START_FROM_END},
+};
+
+constexpr FixedPart EXP_PARTS[] = {
+	{EXP_RULES, FIXED_RULE_COUNT(EXP_RULES), 0, "012", EXP_NAMES, NULL, "", 0},
+	{MULT_RULES, FIXED_RULE_COUNT(MULT_RULES), EXP_MULT, "12", NULL, "Mult*", "SRS", EXP_TO_EXP_RESULT_FOR_UPDATE},
+	{ADD_RULES, FIXED_RULE_COUNT(ADD_RULES), EXP_MULT + MULT_ADD, "2", NULL, "Mult*", "SSR",
+		EXP_MULT + MULT_MOVE_TO_OUTPUT_START_FROM_END},
+};
+
+//the compiled in machines, named as in BUILTIN_MACHINES
+struct FixedAdd {
+	static constexpr int tapes = 1;
+	static constexpr int states = ADD_STATES;
+	static constexpr const FixedPart *parts = ADD_PARTS;
+	static constexpr int nparts = 1;
+};
+
+struct FixedMult {
+	static constexpr int tapes = 2;
+	static constexpr int states = MULT_STATES;
+	static constexpr const FixedPart *parts = MULT_PARTS;
+	static constexpr int nparts = 2;
+};
+
+struct FixedExp {
+	static constexpr int tapes = 3;
+	static constexpr int states = EXP_STATES;
+	static constexpr const FixedPart *parts = EXP_PARTS;
+	static constexpr int nparts = 3;
+};
+
+constexpr int fixedPow3(int n) {
+	return n == 0 ? 1 : 3 * fixedPow3(n - 1);
 }
 
-/* The functions below that return ints are representative of states in the 
- * simulated Turing machine. A negative return value indicates a transition
- * to some other state to the caller, and all return values represent the next
- * cell to move to on the tape by its index (or the negative of its index)
+//the symbol tape t reads in the combination c of symbols under the heads
+constexpr char fixedSymbol(int c, int t) {
+	return "01B"[c / fixedPow3(t) % 3];
+}
+
+//the part whose states include s
+constexpr int fixedPartOf(const FixedPart *parts, int n, int s) {
+	return n == 1 || s >= parts[n - 1].offset ? n - 1 : fixedPartOf(parts, n - 1, s);
+}
+
+constexpr bool fixedReads(const FixedPart &p, const FixedRule &r, int c, int j) {
+	return r.reads[j] == '\0' || ((r.reads[j] == '*' || r.reads[j] == fixedSymbol(c, p.tapes[j] - '0')) &&
+		fixedReads(p, r, c, j + 1));
+}
+
+//the first of the part's rules from i on for state s that reads c, or -1
+constexpr int fixedRuleOf(const FixedPart &p, int s, int c, int i) {
+	return i == p.count ? -1 : p.rules[i].state == s - p.offset && fixedReads(p, p.rules[i], c, 0) ? i :
+		fixedRuleOf(p, s, c, i + 1);
+}
+
+//which of the part's tapes is the machine's tape t, or -1 if the part doesn't use it
+constexpr int fixedPartTape(const FixedPart &p, int t, int j) {
+	return p.tapes[j] == '\0' ? -1 : p.tapes[j] - '0' == t ? j : fixedPartTape(p, t, j + 1);
+}
+
+constexpr int fixedMoveOf(char move) {
+	return move == 'L' ? -1 : move == 'R' ? 1 : 0;
+}
+
+constexpr bool fixedReturns(const FixedPart &p, const FixedRule &r) {
+	return r.next == FIXED_HALT && p.ret_moves[0] != '\0';
+}
+
+//what a transition does, from the rule for state s reading c in the part holding s
+constexpr int fixedNext(const FixedPart &p, int r) {
+	return r < 0 ? FIXED_UNDEFINED : fixedReturns(p, p.rules[r]) ? p.ret_next :
+		p.rules[r].next == FIXED_HALT ? FIXED_HALT : p.offset + p.rules[r].next;
+}
+
+constexpr char fixedWriteOf(const FixedPart &p, char w, int c) {
+	return w == '*' ? 0 : w >= 'a' && w <= 'z' ? fixedSymbol(c, p.tapes[w - 'a'] - '0') : w;
+}
+
+constexpr char fixedWrite(const FixedPart &p, int r, int c, int t) {
+	return r < 0 || fixedPartTape(p, t, 0) < 0 ? 0 : fixedWriteOf(p, p.rules[r].writes[fixedPartTape(p, t, 0)], c);
+}
+
+constexpr int fixedMove(const FixedPart &p, int r, int t) {
+	return r < 0 ? 0 : fixedReturns(p, p.rules[r]) ? fixedMoveOf(p.ret_moves[t]) :
+		fixedPartTape(p, t, 0) < 0 ? 0 : fixedMoveOf(p.rules[r].moves[fixedPartTape(p, t, 0)]);
+}
+
+constexpr bool fixedExtend(const FixedPart &p, int r) {
+	return r >= 0 && p.rules[r].extend;
+}
+
+//transitions for state s of machine M, looked up by the combination c of symbols read
+template <class M>
+struct FixedTransitions {
+	static constexpr int part(int s) {
+		return fixedPartOf(M::parts, M::nparts, s);
+	}
+	static constexpr int rule(int s, int c) {
+		return fixedRuleOf(M::parts[part(s)], s, c, 0);
+	}
+	static constexpr int next(int s, int c) {
+		return fixedNext(M::parts[part(s)], rule(s, c));
+	}
+	static constexpr char write(int s, int c, int t) {
+		return fixedWrite(M::parts[part(s)], rule(s, c), c, t);
+	}
+	static constexpr int move(int s, int c, int t) {
+		return fixedMove(M::parts[part(s)], rule(s, c), t);
+	}
+	static constexpr bool extend(int s, int c) {
+		return fixedExtend(M::parts[part(s)], rule(s, c));
+	}
+
+	static constexpr bool sameTapes(int s, int c1, int c2, int t) {
+		return t == M::tapes || (write(s, c1, t) == write(s, c2, t) && move(s, c1, t) == move(s, c2, t) &&
+			sameTapes(s, c1, c2, t + 1));
+	}
+	static constexpr bool same(int s, int c1, int c2) {
+		return next(s, c1) == next(s, c2) && extend(s, c1) == extend(s, c2) && sameTapes(s, c1, c2, 0);
+	}
+	//whether what state s does depends on the symbol tape t reads, checking combinations from c on
+	static constexpr bool reads(int s, int t, int c) {
+		return c == fixedPow3(M::tapes) ? false : (c / fixedPow3(t) % 3 == 0 &&
+			(!same(s, c, c + fixedPow3(t)) || !same(s, c, c + 2 * fixedPow3(t)))) || reads(s, t, c + 1);
+	}
+	//whether c reads 0 on every tape s doesn't look at, which is how those tapes are left out of its combinations
+	static constexpr bool reachable(int s, int c, int t) {
+		return t == M::tapes || ((c / fixedPow3(t) % 3 == 0 || reads(s, t, 0)) && reachable(s, c, t + 1));
+	}
+
+	//whether state s just moves the head of tape t in direction dir while it reads anything but one symbol
+	static constexpr bool loops(int s, int c, int t, int dir, int u) {
+		return u == M::tapes || (write(s, c, u) == 0 && move(s, c, u) == (u == t ? dir : 0) && loops(s, c, t, dir, u + 1));
+	}
+	static constexpr int stop(int s, int t, int dir, int c, int found) {
+		return c == fixedPow3(M::tapes) || found == -2 ? found :
+			stop(s, t, dir, c + 1, next(s, c) == s && !extend(s, c) && loops(s, c, t, dir, 0) ? found :
+				found == -1 || found == c / fixedPow3(t) % 3 ? c / fixedPow3(t) % 3 : -2);
+	}
+	//the tape, direction and stop symbol of a state that scans as tape * 8 + (dir > 0) * 4 + symbol code, or -1
+	static constexpr int scanFrom(int s, int t) {
+		return t == M::tapes ? -1 : stop(s, t, 1, 0, -1) >= 0 ? t * 8 + 4 + stop(s, t, 1, 0, -1) :
+			stop(s, t, -1, 0, -1) >= 0 ? t * 8 + stop(s, t, -1, 0, -1) : scanFrom(s, t + 1);
+	}
+};
+
+//the tapes as a compiled in machine's states work on them
+struct FixedTapes {
+	vector<vector<char> > *tapes;
+	char *cells[MAX_TAPES];
+	TapeIdx len[MAX_TAPES];
+	TapeIdx head[MAX_TAPES];
+	unsigned long long steps;
+};
+
+//what a compiled in machine's states need besides their tapes
+struct FixedRun {
+	const Machine *m;
+	Tracer *trace;
+	//where the step count goes before anything is traced, as the trace index takes it from there
+	SimContext *ctx;
+	bool accelerate;
+	//the name each state is traced under, and a number that is the same for states with the same name
+	vector<const char *> labels;
+	vector<int> label_ids;
+};
+
+__attribute__((noinline)) void fixedError(const FixedRun &run, int tape) {
+	if (tape < 0)
+		throw runtime_error("machine " + run.m->name + " has no rule for the symbols it read");
+	throw runtime_error("machine " + run.m->name + " moved off the left end of tape " + run.m->tape_names[tape]);
+}
+
+//the combination code of what state S reads on its first T tapes, leaving out tapes it doesn't look at
+template <class M, int S, int T>
+struct FixedRead {
+	static int code(const FixedTapes &tp) {
+		const int t = T - 1;
+		//'0', '1' and 'B' are 0, 1 and 2 in their low bits
+		int sym = !FixedTransitions<M>::reads(S, t, 0) ? 0 : tp.head[t] < tp.len[t] ? tp.cells[t][tp.head[t]] & 3 : 2;
+		return FixedRead<M, S, T - 1>::code(tp) + sym * fixedPow3(t);
+	}
+};
+
+template <class M, int S>
+struct FixedRead<M, S, 0> {
+	static int code(const FixedTapes &) {
+		return 0;
+	}
+};
+
+//the writes and moves of state S reading C, for the first T tapes
+template <class M, int S, int C, int T>
+struct FixedWrite {
+	static void apply(FixedTapes &tp, const FixedRun &run) {
+		FixedWrite<M, S, C, T - 1>::apply(tp, run);
+		const int t = T - 1;
+		const char write = FixedTransitions<M>::write(S, C, t);
+		const bool extend = FixedTransitions<M>::extend(S, C);
+		const int move = FixedTransitions<M>::move(S, C, t);
+		if (write) {
+			if (tp.head[t] + extend < tp.len[t]) {
+				tp.cells[t][tp.head[t]] = write;
+				if (extend)
+					tp.cells[t][tp.head[t] + 1] = 'B';
+			}
+			else {
+				vector<char> &tape = (*tp.tapes)[t];
+				growTape(tape, write, tp.head[t], extend, 'B');
+				tp.cells[t] = tape.data();
+				tp.len[t] = tape.size();
+			}
+		}
+		tp.head[t] += move;
+		if (move < 0 && tp.head[t] < 0)
+			fixedError(run, t);
+	}
+};
+
+template <class M, int S, int C>
+struct FixedWrite<M, S, C, 0> {
+	static void apply(FixedTapes &, const FixedRun &) {}
+};
+
+/* take the step of state S for combination code c, trying the codes below C; codes that S can't read because they
+ * have something other than 0 for a tape it doesn't look at are left out at compile time
  */
+template <class M, int S, int C, bool Reachable = (C > 0 && FixedTransitions<M>::reachable(S, C - 1, 0))>
+struct FixedCase {
+	static int step(int c, FixedTapes &tp, const FixedRun &run) {
+		if (c == C - 1) {
+			FixedWrite<M, S, C - 1, M::tapes>::apply(tp, run);
+			return FixedTransitions<M>::next(S, C - 1);
+		}
+		return FixedCase<M, S, C - 1>::step(c, tp, run);
+	}
+};
 
-//decrement the first input x by 1
-int takeOneX(vector<char> &tape, int idx) {
-	if (tape[idx] == '0') {
-		tape[idx] = '1';
-		return idx + 1;
+template <class M, int S, int C>
+struct FixedCase<M, S, C, false> {
+	static int step(int c, FixedTapes &tp, const FixedRun &run) {
+		return FixedCase<M, S, C - 1>::step(c, tp, run);
 	}
-	if (tape[idx] == '1') {
-		tape[idx] = '0';
+};
+
+template <class M, int S>
+struct FixedCase<M, S, 0, false> {
+	static int step(int, FixedTapes &, const FixedRun &) {
+		return FIXED_UNDEFINED;
 	}
-	return -idx;
+};
+
+//run state S until it moves to another state, which is returned
+template <class M, int S>
+int runFixedState(FixedTapes &io, const FixedRun &run) {
+	const int scan = FixedTransitions<M>::scanFrom(S, 0);
+	const bool trace_steps = run.m->trace_steps;
+	FixedTapes tp = io;
+	int next;
+	do {
+		if (scan >= 0 && run.accelerate && !trace_steps) {
+			const int t = scan / 8;
+			const char stop = "01B"[scan % 4];
+			long long h = tp.head[t], to, end = tp.len[t];
+			if (h >= end)
+				to = stop == 'B' ? h : -1;
+			else if (scan & 4) {
+				to = findCellRight(tp.cells[t], h, end, stop);
+				if (to == end && stop != 'B')
+					to = -1;
+			}
+			else
+				to = findCellLeft(tp.cells[t], h, stop);
+			if (to >= 0) {
+				tp.steps += scan & 4 ? to - h : h - to;
+				tp.head[t] = to;
+			}
+		}
+		next = FixedCase<M, S, fixedPow3(M::tapes)>::step(FixedRead<M, S, M::tapes>::code(tp), tp, run);
+		tp.steps++;
+		if (trace_steps && next != FIXED_UNDEFINED) {
+			bool halted = next == FIXED_HALT;
+			run.ctx->steps = tp.steps;
+			traceMachine(*run.m, halted ? "Halt" : run.labels[next], halted, *tp.tapes, tp.head, *run.trace, false);
+		}
+	} while (next == S);
+	io = tp;
+	return next;
 }
 
-//currently in the first input's cells, keep going until reaching a blank
-int addOneX(vector<char> &tape, int idx) {
-	if (tape[idx] == 'B')
-		return -idx - 1;
-	return idx + 1;
+template <int... I>
+struct FixedIndices {};
+
+//FixedRange<N>::type is FixedIndices<0, 1, ..., N - 1>
+template <int N, int... I>
+struct FixedRange : FixedRange<N - 1, N - 1, I...> {};
+
+template <int... I>
+struct FixedRange<0, I...> {
+	typedef FixedIndices<I...> type;
+};
+
+//run the states of M from Start until it halts, tracing it as it moves between states with different names
+template <class M, int... S>
+void runFixedStates(FixedTapes &tp, const FixedRun &run, FixedIndices<S...>) {
+	typedef int (*StateLoop)(FixedTapes &, const FixedRun &);
+	static const StateLoop loops[] = {&runFixedState<M, S>...};
+	int state = 0;
+	while (1) {
+		int next = loops[state](tp, run);
+		if (next == FIXED_UNDEFINED)
+			fixedError(run, -1);
+		bool halted = next == FIXED_HALT;
+		if (!run.m->trace_steps && (halted || run.label_ids[next] != run.label_ids[state])) {
+			run.ctx->steps = tp.steps;
+			traceMachine(*run.m, halted ? "Halt" : run.labels[next], halted, *tp.tapes, tp.head, *run.trace, false);
+		}
+		if (halted)
+			break;
+		state = next;
+	}
 }
 
-//add 1 to the integer represented in the cells that originally hold the second input y
-int addOneY(vector<char> &tape, int idx) {
-	if (tape[idx] == '1') {
-		tape[idx] = '0';
-		return idx + 1;
+constexpr const char *fixedLabel(const FixedPart &p, int s) {
+	return p.label ? p.label : p.names[s - p.offset];
+}
+
+/* run compiled in machine M on inputs x and y, returning the tape with its result; m is the description of the
+ * same machine, which gives its tapes, inputs and how it is traced
+ */
+template <class M>
+vector<char> runFixed(const Machine &m, const BigNum &x, const BigNum &y, Tracer &trace, SimContext &ctx) {
+	vector<vector<char> > tapes;
+	TapeIdx heads[MAX_TAPES];
+	startMachine(m, x, y, tapes, heads, trace);
+
+	FixedRun run;
+	run.m = &m;
+	run.trace = &trace;
+	run.ctx = &ctx;
+	run.accelerate = ctx.accelerate;
+	for (int s = 0; s < M::states; s++) {
+		run.labels.push_back(fixedLabel(M::parts[fixedPartOf(M::parts, M::nparts, s)], s));
+		int id = s;
+		while (id > 0 && strcmp(run.labels[id - 1], run.labels[s]) != 0)
+			id--;
+		run.label_ids.push_back(id > 0 ? run.label_ids[id - 1] : s);
 	}
-	if (tape[idx] == '0') {
-		tape[idx] = '1';
-		return -idx + 1;
+
+	FixedTapes tp;
+	tp.tapes = &tapes;
+	tp.steps = ctx.steps;
+	for (int t = 0; t < M::tapes; t++) {
+		tp.cells[t] = tapes[t].data();
+		tp.len[t] = tapes[t].size();
+		tp.head[t] = heads[t];
 	}
-	//Blank case - expand the vector that represents the tape
-	tape[idx] = '1';
-	writeSafe(tape, 'B', idx+1);
-	return -idx + 1;
+	runFixedStates<M>(tp, run, typename FixedRange<M::states>::type());
+	copy(tp.head, tp.head + M::tapes, heads);
+	ctx.steps = tp.steps;
+	return machineResult(m, tapes, heads);
 }
 
-//go left until a blank, then go left once more and transition
-int getNextY(vector<char> &tape, int idx) {
-	if (tape[idx] == 'B')
-		return -idx + 1;
-	return idx - 1;
+//take one step of table machine m in state the same way runTable does, returning the state it goes to
+int stepTable(const Machine &m, vector<vector<char> > &tapes, TapeIdx *heads, int state) {
+	size_t idx = state * m.combos;
+	for (int t = 0; t < m.ntapes; t++) {
+		const vector<char> &tape = tapes[t];
+		char c = heads[t] < (TapeIdx)tape.size() ? tape[heads[t]] : m.blank;
+		idx += max(m.code[(unsigned char)c], 0) * m.place[t];
+	}
+	const TableTransition &tr = m.table[idx];
+	if (tr.next == TABLE_UNDEFINED)
+		tableError(m, state, -1);
+	for (int t = 0; t < m.ntapes; t++) {
+		vector<char> &tape = tapes[t];
+		if (heads[t] + tr.extend < (TapeIdx)tape.size()) {
+			tape[heads[t]] = tr.write[t];
+			if (tr.extend && (tr.writes >> t & 1))
+				tape[heads[t] + 1] = m.blank;
+		}
+		else if (tr.writes >> t & 1)
+			growTape(tape, tr.write[t], heads[t], tr.extend, m.blank);
+		heads[t] += tr.move[t];
+		if (heads[t] < 0)
+			tableError(m, state, t);
+	}
+	return tr.next;
 }
 
-//go left until a blank, then go right one time and transition
-int getNextX(vector<char> &tape, int idx) {
-	if (tape[idx] == 'B')
-		return -idx - 1;
-	return idx - 1;
-}
+/* -engine=jit compiles a table machine's transitions into x86-64 code before it runs. Each state becomes a block that
+ * tells what is under the heads apart with compares against the symbols, one tape at a time and only for the tapes
+ * the state's rules depend on, and each leaf of those compares writes its constant symbols, moves the heads by
+ * adding to pointers held in registers and jumps straight to the block of the next state. The called add and mult
+ * machines are inlined into the table, so their states are blocks like any other. Whatever the compiled code leaves
+ * to C++ makes it return with the state it got to: a read or write past the end of a tape (which has to grow),
+ * a move off its left end and a missing rule take that one step with stepTable, and a state change that is traced
+ * hands over to traceTable. Steps go through the same transitions either way, so tapes, traces and step counts are
+ * the same as with -engine=table. Where the code can't be compiled or mapped, the table engine runs instead.
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define TMSIM_JIT 1
 
-/* given a pre-formed input tape, perform an addition and return the index of
- * the blank ('B') char that precedes the output
+//what the compiled code works on, in memory while C++ has it and in registers while the code runs
+struct JitState {
+	//the cell under each head, and the first cell and the end of each tape
+	char *cell[MAX_TAPES];
+	char *begin[MAX_TAPES];
+	char *end[MAX_TAPES];
+	unsigned long long steps;
+	//the state the code starts in, and after it returns the state it got to (TABLE_HALT once the machine halts)
+	int state;
+};
+
+//why compiled code returned: the machine halted, entered a state to trace, or has a step C++ has to take
+const int JIT_HALT = 0;
+const int JIT_TRACE = 1;
+const int JIT_STEP = 2;
+
+/* A table machine compiled to x86-64 code. The code is called as int(JitState *) with the System V calling
+ * convention, and only uses registers a call may overwrite: rdi holds the JitState, rsi the step count, r8 to r11
+ * the cell under the head of each tape, and rax, rcx and rdx are scratch.
  */
-int addSim(vector<char> &tape, string &trace, bool detailed=true) {
-	int cur_idx = 1;
-	if (detailed)
-		trace += "State: Start\nCurrent index: 0\n";
+class JitCode {
+public:
+	JitCode() : mem(nullptr), size(0) {}
+	JitCode(const JitCode &) = delete;
+	JitCode &operator=(const JitCode &) = delete;
+	~JitCode() {
+		if (mem)
+			munmap(mem, size);
+	}
 
-	while (1) {
-		//subtract 1 from x by traversing it from the left and changing bit values
-		while (cur_idx > 0) {
-			if (detailed)
-				trace += string(tape.begin(), tape.end()) + "\n\nState: TakeOneX\nCurrent index: " + (to_string(cur_idx)) + "\n";
-			cur_idx = takeOneX(tape, cur_idx);
+	/* compile m, returning false if the code can't be made executable. With traced, the code returns every time the
+	 * machine enters a state that is traced; otherwise it only returns to halt or for a step it leaves to C++
+	 */
+	bool compile(const Machine &m, bool traced) {
+		//the symbols a head might read are kept as the bits of an unsigned
+		if (m.combos > 1 && (m.ntapes == 1 ? m.combos : m.place[1]) > 32)
+			return false;
+		this->m = &m;
+		this->traced = traced;
+		code.clear();
+		fixups.clear();
+		labels.assign(m.state_names.size(), -1);
+		for (int e = 0; e < 3; e++)
+			exits[e] = newLabel();
+		step_exits.assign(m.state_names.size(), -1);
+
+		//load the registers and jump to the block of the state in JitState
+		for (int t = 0; t < m.ntapes; t++)
+			memOp(0x4C, 0x8B, t, CELL + 8 * t);
+		emit({0x48, 0x8B, 0x77, STEPS});
+		emit({0x8B, 0x47, STATE, 0x48, 0x8D, 0x15});
+		size_t table_ref = code.size();
+		emit32(0);
+		emit({0xFF, 0x24, 0xC2});
+
+		for (size_t s = 0; s < m.state_names.size(); s++) {
+			bind(s);
+			vector<unsigned> allowed(m.ntapes, ~0u);
+			emitNode(s, allowed, 0);
 		}
-		cur_idx = -cur_idx;
-		
-		//Addition is finished in this case, since ending at a blank means all bits in place of the input are now 0
-		if (tape[cur_idx] == 'B') {
-			//x was subtracted from itself and added to the section of tape cells that contained y
-			if (detailed) {
-				trace += string(tape.begin(), tape.end()) + "\n\nState: Halt\nCurrent index: " + (to_string(cur_idx)) + "\n" + string(tape.begin(), tape.end());
-				tape.erase(tape.begin(), tape.begin() + cur_idx);
+		for (size_t s = 0; s < step_exits.size(); s++) {
+			if (step_exits[s] < 0)
+				continue;
+			bind(step_exits[s]);
+			exitTo(s, JIT_STEP);
+		}
+		//each exit stores the state in ecx and the registers before returning
+		for (int e = 0; e < 3; e++) {
+			bind(exits[e]);
+			emit({0x89, 0x4F, STATE});
+			for (int t = 0; t < m.ntapes; t++)
+				memOp(0x4C, 0x89, t, CELL + 8 * t);
+			emit({0x48, 0x89, 0x77, STEPS, 0xB8});
+			emit32(e);
+			emit({0xC3});
+		}
+		for (size_t i = 0; i < fixups.size(); i++)
+			put32(fixups[i].first, labels[fixups[i].second] - (fixups[i].first + 4));
+
+		//the address of each state's block, for the jump in to it
+		while (code.size() % 8)
+			code.push_back(0xCC);
+		size_t table = code.size();
+		put32(table_ref, table - (table_ref + 4));
+		code.resize(table + 8 * m.state_names.size());
+		size = code.size();
+		void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			return false;
+		mem = p;
+		for (size_t s = 0; s < m.state_names.size(); s++) {
+			uint64_t addr = (uint64_t)(uintptr_t)((char *)mem + labels[s]);
+			memcpy(&code[table + 8 * s], &addr, 8);
+		}
+		memcpy(mem, code.data(), size);
+		if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0)
+			return false;
+		entry = (int (*)(JitState *))mem;
+		return true;
+	}
+
+	//run the code from st.state until it returns, giving the reason
+	int run(JitState &st) const {
+		return entry(&st);
+	}
+
+private:
+	static const int CELL = offsetof(JitState, cell);
+	static const int BEGIN = offsetof(JitState, begin);
+	static const int END = offsetof(JitState, end);
+	static const int STEPS = offsetof(JitState, steps);
+	static const int STATE = offsetof(JitState, state);
+	//condition codes of the jumps used
+	static const int JB = 0x2, JAE = 0x3, JE = 0x4, JNE = 0x5;
+
+	const Machine *m;
+	bool traced;
+	vector<unsigned char> code;
+	//where each label is in code, the labels of the states coming first
+	vector<long long> labels;
+	//the offsets of jumps and the labels they go to
+	vector<pair<size_t, int> > fixups;
+	int exits[3];
+	//the label that returns for C++ to take a state's step, made when first used
+	vector<int> step_exits;
+	void *mem;
+	size_t size;
+	int (*entry)(JitState *);
+
+	void emit(initializer_list<int> bytes) {
+		for (initializer_list<int>::const_iterator it = bytes.begin(); it != bytes.end(); ++it)
+			code.push_back(*it);
+	}
+	void emit32(int32_t v) {
+		code.resize(code.size() + 4);
+		put32(code.size() - 4, v);
+	}
+	void put32(size_t at, int32_t v) {
+		memcpy(&code[at], &v, 4);
+	}
+	int newLabel() {
+		labels.push_back(-1);
+		return labels.size() - 1;
+	}
+	void bind(int label) {
+		labels[label] = code.size();
+	}
+	//a jump to label, or a conditional one with cc
+	void jump(int label, int cc = -1) {
+		if (cc < 0)
+			emit({0xE9});
+		else
+			emit({0x0F, 0x80 + cc});
+		fixups.push_back(make_pair(code.size(), label));
+		emit32(0);
+	}
+	//an instruction between the register of tape t and [rdi + disp]
+	void memOp(int rex, int op, int t, int disp) {
+		emit({rex, op, 0x47 | t << 3, disp});
+	}
+	void stepExit(size_t s, int cc) {
+		if (step_exits[s] < 0)
+			step_exits[s] = newLabel();
+		jump(step_exits[s], cc);
+	}
+	//return with state in JitState and why
+	void exitTo(int state, int why) {
+		emit({0xB9});
+		emit32(state);
+		jump(exits[why]);
+	}
+
+	//what a transition does, with the symbols it writes only for the tapes it writes to
+	string ruleKey(const TableTransition &tr) const {
+		if (tr.next == TABLE_UNDEFINED)
+			return "?";
+		string key = to_string(tr.next) + (tr.extend ? "e" : "") + ":";
+		for (int t = 0; t < m->ntapes; t++)
+			key += string(1, tr.writes >> t & 1 ? tr.write[t] : '*') + to_string(tr.move[t]) + ",";
+		return key;
+	}
+
+	int symbols() const {
+		return m->ntapes == 1 ? m->combos : m->place[1];
+	}
+
+	//the transitions of state s for each combination of symbols that has one of the allowed symbols on every tape
+	string nodeKey(size_t s, const vector<unsigned> &allowed) const {
+		string key;
+		for (int c = 0; c < m->combos; c++) {
+			bool match = true;
+			for (int t = 0; t < m->ntapes && match; t++)
+				match = allowed[t] >> (c / m->place[t] % symbols()) & 1;
+			if (match)
+				key += ruleKey(m->table[s * m->combos + c]) + ";";
+		}
+		return key;
+	}
+
+	//how many of the combinations of allowed symbols go from state s back to s
+	int selfLoops(size_t s, const vector<unsigned> &allowed) const {
+		int res = 0;
+		for (int c = 0; c < m->combos; c++) {
+			bool match = true;
+			for (int t = 0; t < m->ntapes && match; t++)
+				match = allowed[t] >> (c / m->place[t] % symbols()) & 1;
+			if (match && m->table[s * m->combos + c].next == (int)s)
+				res++;
+		}
+		return res;
+	}
+
+	/* the code for state s once the symbols under the heads are known to be among those allowed, and the tapes in
+	 * checked are known to have their heads on the tape. It tells the symbols of one more tape apart until what is
+	 * left has the same transition whatever the symbols
+	 */
+	void emitNode(size_t s, vector<unsigned> &allowed, unsigned checked) {
+		const Machine &mm = *m;
+		int syms = symbols();
+		for (int t = 0; t < mm.ntapes; t++) {
+			if (checked >> t & 1)
+				continue;
+			//group the symbols of tape t that lead to the same transitions
+			vector<string> keys;
+			vector<int> loops(syms);
+			for (int sym = 0; sym < syms; sym++) {
+				allowed[t] = 1u << sym;
+				keys.push_back(nodeKey(s, allowed));
+				loops[sym] = selfLoops(s, allowed);
+			}
+			vector<int> group(syms, -1);
+			int groups = 0;
+			for (int sym = 0; sym < syms; sym++) {
+				for (int other = 0; other < sym && group[sym] < 0; other++)
+					if (keys[other] == keys[sym])
+						group[sym] = group[other];
+				if (group[sym] < 0)
+					group[sym] = groups++;
+			}
+			allowed[t] = ~0u;
+			if (groups == 1)
+				continue;
+
+			/* the symbols of every group but one are compared against, and the rest fall through. The group with the
+			 * most symbols falls through, or the one that stays in the state, so that a run of the state over the
+			 * symbols it passes over takes no jump it could mispredict
+			 */
+			vector<int> score(groups);
+			for (int sym = 0; sym < syms; sym++)
+				score[group[sym]] += 1000 + loops[sym];
+			int rest = max_element(score.begin(), score.end()) - score.begin();
+
+			//the head has to be on the tape to read it
+			memOp(0x4C, 0x3B, t, END + 8 * t);
+			stepExit(s, JAE);
+			vector<int> group_labels(groups);
+			for (int g = 0; g < groups; g++) {
+				if (g == rest)
+					continue;
+				group_labels[g] = newLabel();
+				for (int sym = 0; sym < syms; sym++) {
+					if (group[sym] != g)
+						continue;
+					emit({0x41, 0x80, 0x38 | t, (unsigned char)symbolOf(sym)});
+					jump(group_labels[g], JE);
+				}
+			}
+			for (int i = 0; i < groups; i++) {
+				int g = i == 0 ? rest : i <= rest ? i - 1 : i;
+				if (g != rest)
+					bind(group_labels[g]);
+				allowed[t] = 0;
+				for (int sym = 0; sym < syms; sym++)
+					if (group[sym] == g)
+						allowed[t] |= 1u << sym;
+				emitNode(s, allowed, checked | 1 << t);
+			}
+			allowed[t] = ~0u;
+			return;
+		}
+		//every combination left has the same transition, so any of them will do
+		size_t c = 0;
+		for (int t = 0; t < mm.ntapes; t++)
+			c += __builtin_ctz(allowed[t]) * mm.place[t];
+		emitLeaf(s, mm.table[s * mm.combos + c], allowed, checked);
+	}
+
+	char symbolOf(int sym) const {
+		for (int c = 0; c < 256; c++)
+			if (m->code[c] == sym)
+				return c;
+		return m->blank;
+	}
+
+	//the code for one transition of state s, with the symbols under the heads among those allowed
+	void emitLeaf(size_t s, const TableTransition &tr, const vector<unsigned> &allowed, unsigned checked) {
+		const Machine &mm = *m;
+		if (tr.next == TABLE_UNDEFINED) {
+			stepExit(s, -1);
+			return;
+		}
+		//C++ takes the step if it grows a tape or moves off one
+		for (int t = 0; t < mm.ntapes; t++) {
+			if (!(tr.writes >> t & 1))
+				continue;
+			if (tr.extend) {
+				emit({0x49, 0x8D, 0x40 | t, 0x01, 0x48, 0x3B, 0x47, END + 8 * t});
+				stepExit(s, JAE);
+			}
+			else if (!(checked >> t & 1)) {
+				memOp(0x4C, 0x3B, t, END + 8 * t);
+				stepExit(s, JAE);
+			}
+		}
+		for (int t = 0; t < mm.ntapes; t++) {
+			if (tr.move[t] < 0) {
+				memOp(0x4C, 0x3B, t, BEGIN + 8 * t);
+				stepExit(s, JE);
 			}
-			return cur_idx;
 		}
-		
-		//get to the single blank cell that separated the 2 inputs, then go right once to y
-		while (cur_idx > 0) {
-			if (detailed)
-				trace += string(tape.begin(), tape.end()) + "\n\nState: AddOneX\nCurrent index: " + (to_string(cur_idx)) + "\n";
-			cur_idx = addOneX(tape, cur_idx);
+		for (int t = 0; t < mm.ntapes; t++) {
+			if (!(tr.writes >> t & 1))
+				continue;
+			//a symbol that is already there doesn't need writing
+			if (allowed[t] != 1u << m->code[(unsigned char)tr.write[t]])
+				emit({0x41, 0xC6, t, (unsigned char)tr.write[t]});
+			if (tr.extend)
+				emit({0x41, 0xC6, 0x40 | t, 0x01, (unsigned char)mm.blank});
 		}
-		cur_idx = -cur_idx;
-		
-		//add the one subtracted from x to y
-		while (cur_idx > 0) {
-			if (detailed)
-				trace += string(tape.begin(), tape.end()) + "\n\nState: AddOneY\nCurrent index: " + (to_string(cur_idx)) + "\n";
-			cur_idx = addOneY(tape, cur_idx);
+		for (int t = 0; t < mm.ntapes; t++) {
+			if (tr.move[t] > 0)
+				emit({0x49, 0xFF, 0xC0 | t});
+			else if (tr.move[t] < 0)
+				emit({0x49, 0xFF, 0xC8 | t});
 		}
-		cur_idx = -cur_idx;
-		
-		//now go back to the separating blank and then left one more time to reach the x cells
-		while (cur_idx > 0) {
-			if (detailed)
-				trace += string(tape.begin(), tape.end()) + "\n\nState: GetNextY\nCurrent index: " + (to_string(cur_idx)) + "\n";
-			cur_idx = getNextY(tape, cur_idx);
+		emit({0x48, 0xFF, 0xC6});
+		if (tr.next == TABLE_HALT)
+			exitTo(TABLE_HALT, JIT_HALT);
+		else if (traced && (mm.trace_steps || mm.labels[tr.next] != mm.labels[s]))
+			exitTo(tr.next, JIT_TRACE);
+		else
+			jump(tr.next);
+	}
+};
+#endif
+
+/* run a table machine on inputs x and y with the code -engine=jit compiles it to, returning the tape with its result.
+ * traced says whether the trace is kept; if it isn't, the code only stops when it has to. Falls back on runMachine
+ * where the machine can't be compiled
+ */
+vector<char> runJit(const Machine &m, const BigNum &x, const BigNum &y, Tracer &trace, SimContext &ctx, bool traced) {
+#ifdef TMSIM_JIT
+	JitCode jit;
+	if (!jit.compile(m, traced))
+		return runMachine(m, x, y, trace, ctx);
+	vector<vector<char> > tapes;
+	TapeIdx heads[MAX_TAPES];
+	startMachine(m, x, y, tapes, heads, trace);
+	JitState st;
+	st.steps = ctx.steps;
+	st.state = m.start;
+	while (st.state != TABLE_HALT) {
+		//a step taken in C++ can move a tape's cells
+		for (int t = 0; t < m.ntapes; t++) {
+			st.begin[t] = tapes[t].data();
+			st.end[t] = st.begin[t] + tapes[t].size();
+			st.cell[t] = st.begin[t] + heads[t];
 		}
-		cur_idx = -cur_idx;
-		
-		//go to the first cell for x to start the next iteration
-		while (cur_idx >= 0) {
-			if (detailed)
-				trace += string(tape.begin(), tape.end()) + "\n\nState: GetNextX\nCurrent index: " + (to_string(cur_idx)) + "\n";
-			cur_idx = getNextX(tape, cur_idx);
+		int why = jit.run(st);
+		for (int t = 0; t < m.ntapes; t++)
+			heads[t] = st.cell[t] - st.begin[t];
+		ctx.steps = st.steps;
+		if (why != JIT_STEP) {
+			traceTable(m, st.state, tapes, heads, trace, false);
+			continue;
 		}
-		cur_idx = -cur_idx;
+		int next = stepTable(m, tapes, heads, st.state);
+		ctx.steps = ++st.steps;
+		if (next == TABLE_HALT || m.trace_steps || m.labels[next] != m.labels[st.state])
+			traceTable(m, next, tapes, heads, trace, false);
+		st.state = next;
 	}
+	return machineResult(m, tapes, heads);
+#else
+	(void)traced;
+	return runMachine(m, x, y, trace, ctx);
+#endif
 }
 
-//initialize a tape with 2 arguments x,y for add, with three blanks 
-void initTape(int x, int y, vector<char> &tape) {
-	//Bx...By...B
-	vector<char> vec_x = binVector(x);
-	vector<char> vec_y = binVector(y);
-	tape.push_back('B');
-	tape.insert(tape.end(), vec_x.begin(), vec_x.end());
-	tape.push_back('B');
-	tape.insert(tape.end(), vec_y.begin(), vec_y.end());
-	tape.push_back('B');
+/* run the simulation for "-add", "-mult", "-exp", "-mult-fast" or "-exp-fast" on the given kind of tape and return
+ * the number on its final tape, read from the tape itself rather than a copy of it
+ */
+template <class Tape>
+BigNum runOperation(const string &operation, const BigNum &x, const BigNum &y, Tracer &trace, SimContext &ctx) {
+	if (operation == "-add")
+		return interpretTapeRes(view(add<Tape>(x, y, trace, ctx)));
+	if (operation == "-mult")
+		return interpretTapeRes(view(mult<Tape>(x, y, trace, ctx)));
+	if (operation == "-mult-fast")
+		return interpretTapeRes(view(multFast<Tape>(x, y, trace, ctx)));
+	if (operation == "-exp-fast")
+		return interpretTapeRes(view(expFast<Tape>(x, y, trace, ctx)));
+	return interpretTapeRes(view(exp<Tape>(x, y, trace, ctx)));
 }
 
-//perform an addition in a simulated TM given the int args
-vector<char> add(int x, int y, string &trace) {
-	string str_x = to_string(x);
-	string str_y = to_string(y);
-	vector<char> tape;
-	initTape(x, y, tape);
-	trace = "Trace for " + str_x + " + " + str_y + "\n\n";
-	addSim(tape, trace);
-	return tape;
+//a number as it appears in a trace file name, shortened if it is too long for one
+string fileNamePart(const string &num) {
+	if (num.size() <= 40)
+		return num;
+	return num.substr(0, 20) + "_" + to_string(num.size()) + "digits";
 }
 
-//given a tape of the form BxB, where x is the result, interpret it as an int
-int interpretTapeRes(vector<char> tape) {
-	tape.erase(tape.begin());
-	tape.pop_back();
-	return vecToInt(tape);
+//if arg has the form name=value, put the value in value
+bool optionValue(const string &arg, const string &name, string &value) {
+	if (arg.compare(0, name.size() + 1, name + "=") != 0)
+		return false;
+	value = arg.substr(name.size() + 1);
+	return true;
 }
 
-//make trace information string for one step in the exponentiation TM simulation
-string traceStepExp(string state_name, int mult_idx, int exp_idx, vector<char> exp_tape, vector<char> mult_tape) {
-	string step = "State: " + state_name + "\nCurrent Mult Index: " + (to_string(mult_idx)) +
-		"\nCurrent Exp Index: " + (to_string(exp_idx)) + "\nCurrent Mult Tape: " +
-		(string(mult_tape.begin(), mult_tape.end())) + "\nCurrent Exp Tape: " +
-		(string(exp_tape.begin(), exp_tape.end())) + "\n\n";
-	return step;
+//put the decimal number in str in value, or false if str is anything else or doesn't fit in 64 bits
+bool parseCount(const string &str, unsigned long long &value) {
+	if (str.empty() || str.find_first_not_of("0123456789") != string::npos)
+		return false;
+	errno = 0;
+	value = strtoull(str.c_str(), nullptr, 10);
+	return errno == 0;
 }
 
-/* copy chars from read tape to write tape in order from the given indices in
- * each, up to and including the next blank (left to right)
- */
-void copyUntilBlank(vector<char> &tape_read, vector<char> &tape_write, int &idx_r, int &idx_w) {
-	while (tape_read[idx_r] != 'B') {
-		if (idx_w >= (int)tape_write.size())
-			tape_write.resize(idx_w + 1, 'B');
-		tape_write[idx_w] = tape_read[idx_r];
-		idx_r++;
-		idx_w++;
+//put the number given to option in value, or say on stderr that it isn't one from least to most and return false
+bool countOption(const string &option, const string &str, unsigned long long least, unsigned long long most,
+		unsigned long long &value) {
+	if (parseCount(str, value) && value >= least && value <= most)
+		return true;
+	std::cerr << option + " takes a whole number from " + to_string(least) + " to " + to_string(most) + ", not \'" + str + "\'\n";
+	return false;
+}
+
+//one record listed in a trace index
+struct IndexEntry {
+	unsigned long long step;
+	unsigned long long offset;
+	int kind;
+};
+
+//reads the records listed in a trace index in order, from any step on (see TraceIndex)
+class TraceIndexReader {
+public:
+	explicit TraceIndexReader(const string &filename) : in(filename.c_str(), ios::binary), filename(filename), block(0), pos(0) {
+		char header[INDEX_HEADER];
+		if (!in.read(header, INDEX_HEADER))
+			throw runtime_error("Could not read trace index \'" + filename + "\', which is written along with text traces");
+		if (memcmp(header, INDEX_MAGIC, 4) != 0 || (unsigned char)header[4] != INDEX_VERSION)
+			throw runtime_error("\'" + filename + "\' is not a trace index from this version of tmsim");
+		in.seekg(0, ios::end);
+		size = in.tellg();
+		//the last block is cut short
+		blocks = (size - INDEX_HEADER + INDEX_BLOCK - 1) / INDEX_BLOCK;
+		load(0);
 	}
-	if (idx_w >= (int)tape_write.size())
-		tape_write.resize(idx_w+1, 'B');
-	
-	tape_write[idx_w] = 'B';
-	idx_w--;
-	idx_r--;
+
+	/* go to the record of step, or if it has none the last step before it that has one, and the first of them
+	 * where several records have the same step. Text records don't count. Returns false if there is no such record.
+	 */
+	bool seekStep(unsigned long long step) {
+		//records of step can start in the block before the first one that starts with step
+		unsigned long long lo = 0, hi = blocks;
+		while (hi - lo > 1) {
+			unsigned long long mid = lo + (hi - lo) / 2;
+			if (firstStep(mid) < step)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		load(lo);
+		bool found = false;
+		unsigned long long found_block = 0, found_step = 0;
+		size_t found_pos = 0;
+		IndexEntry e;
+		while (peek(e) && e.step <= step) {
+			if ((e.kind & 3) != INDEX_TEXT && (!found || e.step != found_step)) {
+				found = true;
+				found_block = block;
+				found_pos = pos;
+				found_step = e.step;
+			}
+			pos++;
+		}
+		if (found) {
+			load(found_block);
+			pos = found_pos;
+		}
+		return found;
+	}
+
+	//the record at the current position, or false at the end of the index
+	bool peek(IndexEntry &e) {
+		while (pos == entries.size()) {
+			if (block + 1 >= blocks)
+				return false;
+			load(block + 1);
+		}
+		e = entries[pos];
+		return true;
+	}
+	bool next(IndexEntry &e) {
+		if (!peek(e))
+			return false;
+		pos++;
+		return true;
+	}
+private:
+	//the step of the first record in block b
+	unsigned long long firstStep(unsigned long long b) {
+		char step[8];
+		in.seekg(INDEX_HEADER + b * INDEX_BLOCK);
+		if (!in.read(step, 8))
+			throw runtime_error("Could not read trace index \'" + filename + "\'");
+		return readFixed(step, 8);
+	}
+
+	//read in the records of block b, and go to the first of them
+	void load(unsigned long long b) {
+		block = b;
+		pos = 0;
+		entries.clear();
+		if (b >= blocks)
+			return;
+		unsigned long long from = INDEX_HEADER + b * INDEX_BLOCK;
+		string data(min((unsigned long long)INDEX_BLOCK, size - from), '\0');
+		in.seekg(from);
+		if (data.size() < 20 || !in.read(&data[0], data.size()))
+			throw runtime_error("Could not read trace index \'" + filename + "\'");
+		IndexEntry e = {readFixed(&data[0], 8), readFixed(&data[8], 8), 0};
+		unsigned count = readFixed(&data[16], 4);
+		istringstream records(data.substr(20));
+		DeltaReader r(records, "trace index \'" + filename + "\'");
+		for (unsigned i = 0; i < count; i++) {
+			e.step += r.varint();
+			e.offset += r.varint();
+			e.kind = r.byte();
+			entries.push_back(e);
+		}
+	}
+
+	ifstream in;
+	string filename;
+	unsigned long long size;
+	unsigned long long blocks;
+	unsigned long long block;
+	vector<IndexEntry> entries;
+	size_t pos;
+};
+
+//the bytes of a file from offset up to end, or to the end of the file if end is 0
+string readRange(istream &in, unsigned long long offset, unsigned long long end) {
+	if (end == 0) {
+		in.seekg(0, ios::end);
+		end = in.tellg();
+	}
+	string res(end > offset ? end - offset : 0, '\0');
+	in.seekg(offset);
+	in.read(&res[0], res.size());
+	return res;
 }
 
-/* for add tape, moves from the last char before the last blank to the first
- * char after the first blank
- */
-void moveToInputStart(vector<char> &tape, int &idx) {
-	while (idx > 0)
-		idx = getNextY(tape, idx);
-	idx = -idx;
-	while (idx >= 0)
-		idx = getNextX(tape, idx);
-	idx = -idx;
+//print count records of a text trace from the one of step, found with the trace's index
+int replay(const string &filename, unsigned long long step, unsigned long long count) {
+	try {
+		ifstream in(filename.c_str(), ios::binary);
+		if (!in)
+			throw runtime_error("Could not open trace file \'" + filename + "\'");
+		TraceIndexReader index(filename + ".idx");
+		if (!index.seekStep(step))
+			throw runtime_error("\'" + filename + "\' has no records");
+		IndexEntry first = {0, 0, 0}, e;
+		index.next(first);
+		//the records end where the one after them starts, be it a record or text
+		unsigned long long end = 0;
+		for (unsigned long long found = 1; index.next(e); found += (e.kind & 3) != INDEX_TEXT) {
+			if (found == count) {
+				end = e.offset;
+				break;
+			}
+		}
+		string records = readRange(in, first.offset, end);
+		records.erase(0, records.find_first_not_of('\n'));
+		std::cout << "From step " + to_string(first.step) + ":\n" + records + "\n";
+	}
+	catch (const runtime_error &e) {
+		std::cerr << string(e.what()) + "\n";
+		return 1;
+	}
+	return 0;
 }
 
-//see moveToInputStart (this tape stores 3 blank-separated values instead of 2)
-void moveToMultStart(vector<char> &tape, int &idx) {
-	while (idx > 0)
-		idx = getNextY(tape, idx);
-	idx = -idx;
-	while (idx > 0)
+//the states of add in the order it goes through them, as it is traced
+const char *const ADD_STATE_NAMES[] = {"TakeOneX", "AddOneX", "AddOneY", "GetNextY", "GetNextX"};
+
+/* take one step of add in state (an index into ADD_STATE_NAMES) with its head at idx, as addSim would, and move on to
+ * the state it goes to if it leaves this one. state becomes -1 when add halts.
+ */
+void stepAdd(vector<char> &tape, int &state, TapeIdx &idx) {
+	switch (state) {
+	case 0:
+		idx = takeOneX(tape, idx);
+		break;
+	case 1:
+		idx = addOneX(tape, idx);
+		break;
+	case 2:
+		idx = addOneY(tape, idx);
+		break;
+	case 3:
 		idx = getNextY(tape, idx);
-	idx = -idx;
-	while (idx >= 0)
+		break;
+	default:
 		idx = getNextX(tape, idx);
-	idx = -idx;
+		break;
+	}
+	//a state that would take no more steps is left right away, as addSim's loops are
+	while (state >= 0 && !(state == 4 ? idx >= 0 : idx > 0)) {
+		idx = -idx;
+		state = state == 0 && tape[idx] == 'B' ? -1 : (state + 1) % 5;
+	}
 }
 
-//make a string of information about the current state for the trace
-string traceStep(string state_name, int add_idx, int mult_idx, vector<char> mult_tape, vector<char> add_tape) {
-	string step = "State: " + state_name + "\nCurrent Add Index: " + (to_string(add_idx)) + 
-		"\nCurrent Mult Index: " + (to_string(mult_idx)) + "\nCurrent Add Tape: " + 
-		(string(add_tape.begin(), add_tape.end())) + "\nCurrent Mult Tape: " + 
-		(string(mult_tape.begin(), mult_tape.end())) + "\n\n";
-	return step;
+//where the last line before offset starts in a trace, which for a step is the line with the tape it starts from
+unsigned long long lineBefore(istream &in, unsigned long long offset) {
+	const unsigned long long chunk = 1 << 16;
+	while (offset > 0) {
+		unsigned long long from = offset > chunk ? offset - chunk : 0;
+		string part = readRange(in, from, offset);
+		size_t nl = part.rfind('\n');
+		if (nl != string::npos)
+			return from + nl + 1;
+		offset = from;
+	}
+	return 0;
 }
 
-//simulate a multiplication on a given mult tape and a blank add tape
-int multSim(vector<char> &add_tape, vector<char> &tape, string &trace, bool detailed = true) {
-	//move to the second cell after the blank in each tape to start
-	int mult_idx = 1;
-	int add_idx = 1;
-	//multiply by repeated addition of x copies of y
-	while (1) {
-		//decrement x by 1
-		if (detailed) {
-			trace += traceStep("TakeOneInX", add_idx, mult_idx, tape, add_tape);
-		}
-		while (mult_idx > 0) {
-			mult_idx = takeOneX(tape, mult_idx);
-		}
-		mult_idx = -mult_idx;
-		if (tape[mult_idx] == 'B') {
-			// when x=0 on the mult tape, the multiplication is finished
-			//TakeOneInX moves right when the current cell has a blank and transitions
-			mult_idx++;
-			if (detailed)
-				trace += traceStep("MoveToOutputFromY", add_idx, mult_idx, tape, add_tape);
-			//position tape head at blank right before first bit of output
-			while (mult_idx > 0)
-				mult_idx = addOneX(tape, mult_idx);
-			mult_idx = -mult_idx-1;
-			if (detailed) {
-				trace += traceStep("Halt", add_idx, mult_idx, tape, add_tape);
-				tape.erase(tape.begin(), tape.begin() + mult_idx);
+/* print the configuration of a traced machine after step steps. The nearest record at or before step is found with
+ * the trace's index, and where that is a step of add with the whole tape, add is run on from there to step.
+ */
+int replayTape(const string &filename, unsigned long long step) {
+	try {
+		ifstream in(filename.c_str(), ios::binary);
+		if (!in)
+			throw runtime_error("Could not open trace file \'" + filename + "\'");
+		TraceIndexReader index(filename + ".idx");
+		if (!index.seekStep(step))
+			throw runtime_error("\'" + filename + "\' has no records");
+		//of several records of the same step, the last has what the machine went on from
+		IndexEntry rec = {0, 0, 0}, e;
+		index.next(rec);
+		unsigned long long end = 0;
+		while (index.next(e)) {
+			if ((e.kind & 3) == INDEX_TEXT || e.step != rec.step) {
+				end = e.offset;
+				break;
 			}
-			//return index of first cell of output
-			return mult_idx+1;
+			rec = e;
 		}
-		if (detailed)
-			trace += traceStep("MoveToYFromX", add_idx, mult_idx, tape, add_tape);
-		//move to the separator blank between x and y, then move right one last time
-		while (mult_idx > 0) {
-			mult_idx = addOneX(tape, mult_idx);
+		int kind = rec.kind & 3;
+		string res;
+		if (kind == INDEX_CONFIG) {
+			string config = readRange(in, rec.offset, end);
+			config.erase(config.find_last_not_of('\n') + 1);
+			res = config.substr(config.find_first_not_of('\n')) + "\n";
 		}
+		else {
+			//"State: ...", "Current index: ..." and, for a window of the tape, "Cells shown: ..."
+			string lines = readRange(in, rec.offset, end && end < rec.offset + 4096 ? end : rec.offset + 4096);
+			istringstream fields(lines.substr(lines.find_first_not_of('\n')));
+			string state_line, idx_line, shown_line;
+			getline(fields, state_line);
+			getline(fields, idx_line);
+			if (getline(fields, shown_line) && shown_line.compare(0, 12, "Cells shown:") != 0)
+				shown_line.clear();
+			if (state_line.compare(0, 7, "State: ") != 0 || idx_line.compare(0, 15, "Current index: ") != 0)
+				throw runtime_error("\'" + filename + "\' doesn't match its index at offset " + to_string(rec.offset));
+			string state_name = state_line.substr(7);
+			TapeIdx idx = atoll(idx_line.c_str() + 15);
+			unsigned long long from = lineBefore(in, rec.offset);
+			vector<char> tape;
+			string cells = readRange(in, from, rec.offset);
+			//the start of a machine has nothing before it, but the first step after it shows the same tape
+			if (cells.empty()) {
+				cells = readRange(in, rec.offset + state_line.size() + idx_line.size() + 2, end);
+				cells.erase(cells.find_last_not_of('\n') + 1);
+			}
+			tape.assign(cells.begin(), cells.end());
 
-		//position mult tape head at first bit of y
-		mult_idx = -mult_idx;
-		if (detailed)
-			trace += traceStep("WriteFirstAddArg", add_idx, mult_idx, tape, add_tape);
-		//write y from the mult tape in the first arg position in the add tape
-		copyUntilBlank(tape, add_tape, mult_idx, add_idx);
-		//want the tape heads to be on the right side of their respective blanks
-		mult_idx += 2;
-		add_idx += 2;
-		if (detailed)
-			trace += traceStep("WriteSecondAddArg", add_idx, mult_idx, tape, add_tape);
-		//make the result so far from the mult tape the second arg on the add tape
-		copyUntilBlank(tape, add_tape, mult_idx, add_idx);
-
-		if (detailed)
-			trace += traceStep("MoveToBeginAdd", add_idx, mult_idx, tape, add_tape);
-		//send tape head in add tape to first bit of its first input after copying result
-		moveToInputStart(add_tape, add_idx);
-
-		if (detailed)
-			trace += traceStep("Add*", add_idx, mult_idx, tape, add_tape);
-		//compute the sum whose input args are on the add tape, and increment position to first bit of answer sum
-		add_idx = addSim(add_tape, trace, false) + 1;
-
-		if (detailed)
-			trace += traceStep("MoveToOutputStartFromEnd", add_idx, mult_idx, tape, add_tape);
-		//position mult tape head at the first cell of where the result goes from the end cell
-		while (mult_idx >= 0)
-			mult_idx = getNextX(tape, mult_idx);
+			int state = find(ADD_STATE_NAMES, ADD_STATE_NAMES + 5, state_name) - ADD_STATE_NAMES;
+			if (kind == INDEX_STEP && state < 5 && shown_line.empty()) {
+				for (; rec.step < step && state >= 0; rec.step++)
+					stepAdd(tape, state, idx);
+				state_name = state >= 0 ? ADD_STATE_NAMES[state] : "Halt";
+				kind = state >= 0 ? INDEX_STEP : INDEX_HALT;
+			}
+			res = "State: " + state_name + "\nCurrent index: " + to_string(idx) + "\n" + (shown_line.empty() ? "" : shown_line + "\n")
+				+ "Tape: " + string(tape.begin(), tape.end()) + "\n";
+		}
+		if (kind == INDEX_HALT)
+			std::cout << "The machine halted after " + to_string(rec.step) + " steps:\n" + res;
+		else if (rec.step == step)
+			std::cout << "After " + to_string(step) + " steps:\n" + res;
+		else
+			std::cout << "Nothing is traced from step " + to_string(rec.step) + " up to step " + to_string(step)
+				+ ". The last configuration traced before it, after " + to_string(rec.step) + " steps:\n" + res;
+	}
+	catch (const runtime_error &e) {
+		std::cerr << string(e.what()) + "\n";
+		return 1;
+	}
+	return 0;
+}
 
-		//mult's tape head at first bit of old result
-		mult_idx = -mult_idx;
+/* expand a delta trace into the text format, in the file with the same name minus its extension, leaving out what
+ * detail's window and sampling do
+ */
+int decode(const string &filename, string out_filename, const TraceDetail &detail) {
+	ifstream in(filename.c_str(), ios::binary);
+	if (!in) {
+		std::cerr << "Could not open delta trace \'" + filename + "\'\n";
+		return 1;
+	}
+	if (out_filename.empty()) {
+		size_t dot = filename.rfind('.');
+		if (dot != string::npos && filename.substr(dot) == ".tmd")
+			out_filename = filename.substr(0, dot);
+		else
+			out_filename = filename + ".txt";
+	}
+	FileTraceSink sink(out_filename);
+	if (!sink.isOpen()) {
+		std::cerr << "Could not open trace file \'" + out_filename + "\'\n";
+		return 1;
+	}
+	TextTracer trace(sink);
+	vector<unique_ptr<Tracer> > detail_tracers;
+	try {
+		decodeDeltaTrace(in, detailTracer(trace, detail, detail_tracers));
+		sink.close();
+	}
+	catch (const runtime_error &e) {
+		std::cerr << filename + ": " + e.what() + "\n";
+		return 1;
+	}
+	std::cout << "Created trace file \'" + out_filename + "\'\n";
+	return 0;
+}
 
-		if (detailed)
-			trace += traceStep("WriteSumBack", add_idx, mult_idx, tape, add_tape);
-		//write new sum from the add tape over old one on the mult tape
-		copyUntilBlank(add_tape, tape, add_idx, mult_idx);
+/* runs a fixed set of jobs on a number of worker threads. Each worker starts with its own queue of jobs, dealt out
+ * in turn, and takes them from the front; once its queue is empty it steals from the back of the others'. A worker
+ * held up by one long job therefore doesn't hold up the jobs queued behind it, which the idle workers take over.
+ */
+class WorkStealingPool {
+public:
+	explicit WorkStealingPool(unsigned workers) {
+		for (unsigned i = 0; i < max(workers, 1u); i++)
+			queues.push_back(unique_ptr<JobQueue>(new JobQueue()));
+	}
+	//call run(i) for every i below njobs and return once all of them have
+	template <class Run>
+	void run(size_t njobs, Run run) {
+		for (size_t i = 0; i < njobs; i++)
+			queues[i % queues.size()]->jobs.push_back(i);
+		vector<thread> workers;
+		for (size_t w = 0; w < queues.size(); w++)
+			workers.push_back(thread([this, w, &run]() {
+				size_t job;
+				while (take(w, job))
+					run(job);
+			}));
+		for (size_t w = 0; w < workers.size(); w++)
+			workers[w].join();
+	}
+	size_t size() const {
+		return queues.size();
+	}
+private:
+	struct JobQueue {
+		mutex mtx;
+		deque<size_t> jobs;
+	};
 
-		if (detailed)
-			trace += traceStep("FirstCellFromEndAddTape*", add_idx, mult_idx, tape, add_tape);
-		//move tape heads back to initial positions for beginning of next iteration
-		moveToInputStart(add_tape, add_idx);
-		if (detailed)
-			trace += traceStep("FirstCellFromEndMultTape*", add_idx, mult_idx, tape, add_tape);
-		moveToMultStart(tape, mult_idx);
+	//the next job for worker w: its own oldest one, or failing that the newest one of another worker
+	bool take(size_t w, size_t &job) {
+		{
+			lock_guard<mutex> lock(queues[w]->mtx);
+			if (!queues[w]->jobs.empty()) {
+				job = queues[w]->jobs.front();
+				queues[w]->jobs.pop_front();
+				return true;
+			}
+		}
+		//no jobs are added once the workers start, so all queues being empty means the work is done
+		for (size_t i = 1; i < queues.size(); i++) {
+			JobQueue &victim = *queues[(w + i) % queues.size()];
+			lock_guard<mutex> lock(victim.mtx);
+			if (!victim.jobs.empty()) {
+				job = victim.jobs.back();
+				victim.jobs.pop_back();
+				return true;
+			}
+		}
+		return false;
 	}
-}
 
-//multiply 2 input ints x and y by inputting them to a simulated 2-tape TM
-vector<char> mult(int x, int y, string &trace, bool detailed=true) {
-	vector<char> tape;
-	vector<char> add_tape;
-	initTape(x, y, tape);
-	//add another value to the mult tape representing the output (0 for now)
-	tape.push_back('0');
-	tape.push_back('B');
-	string str_x = to_string(x);
-	string str_y = to_string(y);
-	if (detailed)
-		trace = "Abbreviated Trace for " + str_x + " x " + str_y + "\n\n";
-	
-	//add tape initially blank
-	add_tape.push_back('B');
-	if (detailed)
-		trace += "State: Start\nCurrent Add Index: 0\nCurrent Mult Index: 0\nInitial Add Tape: " + (string(add_tape.begin(), add_tape.end())) + "\nInitial Mult Tape: " + (string(tape.begin(), tape.end())) + "\n\n";
+	vector<unique_ptr<JobQueue> > queues;
+};
 
-	multSim(add_tape, tape, trace);
-	return tape;
-}
+//how simulations are run and traced, as set on the command line
+struct RunOptions {
+	string format;
+	unsigned keyframe_every;
+	bool packed;
+	//whether the tapes are MappedTapes, in MappedTape::directory
+	bool mapped;
+	string engine;
+	bool accelerate;
+	//whether a trace file is written at all
+	bool trace;
+	TraceDetail detail;
+	//shared by all the runs, if not null
+	ResultCache *cache;
+	//seconds between checkpoints, or 0 for none
+	double checkpoint_every;
+	//where checkpoints go, if not named after the trace
+	string checkpoint_file;
+	//the checkpoint the run carries on from, if any
+	const Checkpoint *resume;
+	//if not 0, the trace is written by this many workers at once (see runParallelTrace())
+	unsigned parallel_trace;
+	//steps between the points the trace is split at for the workers, or 0 to space them out as the run goes
+	unsigned long long parallel_every;
+	//whether the native machines work out what they can from their tapes instead of stepping (see SimContext::analytic)
+	bool count;
+	//whether a counted run is checked against one that steps through all of it
+	bool count_check;
+	RunOptions() : format("text"), keyframe_every(4096), packed(false), mapped(false), engine("native"), accelerate(true), trace(true),
+		cache(nullptr), checkpoint_every(0), resume(nullptr), parallel_trace(0), parallel_every(0), count(false), count_check(false) {}
+};
 
-//simulate an exponentiation TM given input tapes
-int expSim(vector<char> &mult_tape, vector<char> &tape, string &trace) {
-	int mult_idx = 1;
-	int exp_idx = 1;
+//the outcome of one simulation
+struct RunResult {
+	//the trace file, empty if none was written
+	string filename;
+	string res;
+	unsigned long long steps;
+	RunResult() : steps(0) {}
+};
 
-	//only mult will use this tape
-	vector<char> add_tape;
-	add_tape.push_back('B');
+//run operation on the kind of native tape opt asks for and return its result
+BigNum runNative(const RunOptions &opt, const string &operation, const BigNum &x, const BigNum &y, Tracer &trace,
+		SimContext &ctx) {
+	if (opt.packed)
+		return runOperation<PackedTape>(operation, x, y, trace, ctx);
+	if (opt.mapped)
+		return runOperation<MappedTape>(operation, x, y, trace, ctx);
+	return runOperation<OriginTape>(operation, x, y, trace, ctx);
+}
 
-	while (1) {
-		trace += traceStepExp("MoveToYFromXForDecrement", mult_idx, exp_idx, tape, mult_tape);
-		//move from x's position on the exp tape to y's leftmost cell so that it can be decremented
-		while (exp_idx > 0)
-			exp_idx = addOneX(tape, exp_idx);
-		exp_idx = -exp_idx;
+/* write the text trace of a native simulation to filename with opt.parallel_trace workers. The simulation is first
+ * run untraced, keeping a checkpoint in memory every so many steps. The stretches between them are then simulated
+ * again on the workers, each from its checkpoint to the next one and with its trace in a file of its own, and those
+ * files are joined in order. The trace is the same as a run on one thread would write. Checkpoints are spaced
+ * opt.parallel_every steps apart, or if that is 0, start 2^16 apart and twice as far whenever there are more than
+ * 8 for each worker, so there are 4 to 8 stretches for each worker however long the run is.
+ */
+RunResult runParallelTrace(const RunOptions &opt, const string &operation, const string &filename, const BigNum &x,
+		const BigNum &y) {
+	RunResult r;
+	r.filename = filename;
+	//results from the cache would skip over points where the workers' simulations can stop
+	SimContext ctx;
+	ctx.accelerate = opt.accelerate;
+	ctx.trace_transitions = opt.detail.transitions;
+	ctx.trace_nested = opt.detail.nested;
+	//the index and detail tracers still have to be run, as their state goes into the checkpoints
+	NullTracer untraced;
+	IndexTracer untraced_index(untraced, nullptr);
+	vector<unique_ptr<Tracer> > detail_tracers;
+	Tracer &detailed = detailTracer(untraced_index, opt.detail, detail_tracers);
+	vector<Checkpoint> splits;
+	Checkpointer checkpoint("", Checkpoint(), nullptr, detailed);
+	unsigned long long every = opt.parallel_every ? opt.parallel_every : 1 << 16;
+	checkpoint.setStepInterval(every);
+	const size_t most = opt.parallel_every ? 0 : 8 * (size_t)opt.parallel_trace;
+	checkpoint.keepWith([&](const Checkpoint &cp) {
+		splits.push_back(cp);
+		if (splits.size() < most || most == 0)
+			return;
+		//keep every other one, which leaves them twice as far apart
+		for (size_t i = 1; i < splits.size(); i += 2)
+			swap(splits[i / 2], splits[i]);
+		splits.resize(splits.size() / 2);
+		every *= 2;
+		checkpoint.setStepInterval(every);
+	});
+	ctx.checkpoint = &checkpoint;
+	r.res = runNative(opt, operation, x, y, detailed, ctx).toString();
+	r.steps = ctx.steps;
 
-		//decrement y
-		trace += traceStepExp("DecrementY", mult_idx, exp_idx, tape, mult_tape);
-		while (exp_idx > 0) {
-			exp_idx = takeOneX(tape, exp_idx);
+	/* stretch i starts at splits[i - 1] (or the inputs) and ends at splits[i] (or the halt). The first one is written
+	 * straight to filename and the others are added on to it. Each has an index of its own, and the records of those
+	 * go into the index of the whole trace in order, so it comes out the same as the index of a run on one thread.
+	 */
+	size_t nparts = splits.size() + 1;
+	vector<string> parts(nparts);
+	vector<string> errors(nparts);
+	WorkStealingPool pool(opt.parallel_trace);
+	pool.run(nparts, [&](size_t i) {
+		parts[i] = i == 0 ? filename : filename + ".part" + to_string(i);
+		try {
+			FileTraceSink sink(parts[i]);
+			if (!sink.isOpen())
+				throw runtime_error("Could not open trace file \'" + parts[i] + "\'");
+			SimContext part;
+			TextTracer trace(sink);
+			TraceIndex index(filename + ".part" + to_string(i) + ".idx", sink, part.steps);
+			IndexTracer indexed(trace, &index);
+			vector<unique_ptr<Tracer> > part_tracers;
+			Tracer &part_detailed = detailTracer(indexed, opt.detail, part_tracers);
+			part.accelerate = opt.accelerate;
+			part.trace_transitions = opt.detail.transitions;
+			part.trace_nested = opt.detail.nested;
+			Checkpointer stops("", Checkpoint(), nullptr, part_detailed);
+			if (i > 0) {
+				istringstream saved(splits[i - 1].tracer);
+				DeltaReader in(saved, "checkpoint");
+				part_detailed.loadState(in);
+				stops.resumeFrom(splits[i - 1]);
+				part.steps = splits[i - 1].steps;
+			}
+			if (i < splits.size())
+				stops.stopAt(splits[i].steps);
+			part.checkpoint = &stops;
+			try {
+				runNative(opt, operation, x, y, part_detailed, part);
+				part_detailed.text("\n\nInterpreted result of this computation: " + r.res);
+			}
+			catch (const TraceSegmentEnd &) {
+			}
+			sink.close();
+			index.close();
 		}
-		
-		//tape is at position of the tape where a 1 was changed to a 0, or a blank if there wasn't one in y
-		exp_idx = -exp_idx;
-		
-
-		//if a blank was reached in DecrementY, then the result cells have the final output
-		if (tape[exp_idx] == 'B') {
-			//DecrementY transitions to halt state and moves one right upon encountering a blank
-			exp_idx++;
-			trace += traceStepExp("Halt", mult_idx, exp_idx, tape, mult_tape);
-			tape.erase(tape.begin(), tape.begin() + (exp_idx - 1));
-			//return the position of the last bit of the second input before changing the tape
-			return exp_idx - 2;
+		catch (const runtime_error &e) {
+			errors[i] = e.what();
 		}
-		
-		//otherwise, go to the leftmost cell of the section of tape that stores the result so far
-		trace += traceStepExp("MoveToResFromY", mult_idx, exp_idx, tape, mult_tape);
-		while (exp_idx > 0)
-			exp_idx = addOneX(tape, exp_idx);
-		exp_idx = -exp_idx;
-
-		//Write the result as the first arg on the multiplication tape, plus a blank afterward
-		trace += traceStepExp("WriteResAsMultArg", mult_idx, exp_idx, tape, mult_tape);
-		copyUntilBlank(tape, mult_tape, exp_idx, mult_idx);
-		
-		//Next arg on mult tape will start after the new blank, not before it
-		mult_idx += 2;
+	});
 
-		//Now x will be the second arg on the mult tape. Go left to the rightmost bit of y first...
-		trace += traceStepExp("MoveToYForXWrite", mult_idx, exp_idx, tape, mult_tape);
-		while (exp_idx > 0)
-			exp_idx = getNextY(tape, exp_idx);
-		exp_idx = -exp_idx;
-
-		//...and then go left to the rightmost bit of x, and then...
-		trace += traceStepExp("MoveToXForXWrite", mult_idx, exp_idx, tape, mult_tape);
-		while (exp_idx > 0)
-			exp_idx = getNextY(tape, exp_idx);
-		exp_idx = -exp_idx;
-
-		//finally go left to the first cell of x to begin write to mult tape
-		trace += traceStepExp("MoveToXBeginFromXEndForXWrite", mult_idx, exp_idx, tape, mult_tape);
-		while (exp_idx >= 0)
-			exp_idx = getNextX(tape, exp_idx);
-		exp_idx = -exp_idx;
-
-		//write x to the mult tape at the second arg position
-		trace += traceStepExp("WriteXAsMultArg", mult_idx, exp_idx, tape, mult_tape);
-		copyUntilBlank(tape, mult_tape, exp_idx, mult_idx);
-		
-		/* WriteXAsMultArg should move exp tape head right once to leftmost bit of y from blank that causes transition
-		 * instead of left once as in copyUntilBlank function default
-		 */
-		exp_idx += 2;
+	ofstream out(filename.c_str(), ios::binary | ios::app);
+	TraceIndex index(filename + ".idx");
+	//where the part being added starts in the whole trace
+	unsigned long long base = 0;
+	string error;
+	for (size_t i = 0; i < nparts; i++) {
+		if (error.empty())
+			error = errors[i];
+		string part_index = filename + ".part" + to_string(i) + ".idx";
+		if (error.empty()) {
+			try {
+				//the records of the part's index only need their offsets moved along
+				TraceIndexReader in_index(part_index);
+				IndexEntry e;
+				while (in_index.next(e))
+					index.put(e.step, base + e.offset, e.kind);
+			}
+			catch (const runtime_error &e) {
+				error = e.what();
+			}
+			ifstream in(parts[i].c_str(), ios::binary | ios::ate);
+			unsigned long long size = in.tellg();
+			in.seekg(0);
+			//a stretch inside an untraced black box state has no trace, and copying nothing counts as failing
+			if (i > 0 && size > 0)
+				out << in.rdbuf();
+			base += size;
+		}
+		if (i > 0)
+			remove(parts[i].c_str());
+		remove(part_index.c_str());
+	}
+	out.close();
+	if (error.empty() && !out)
+		error = "Could not write trace file \'" + filename + "\'";
+	if (error.empty()) {
+		try {
+			index.close();
+		}
+		catch (const runtime_error &e) {
+			error = e.what();
+		}
+	}
+	if (!error.empty())
+		throw runtime_error(error);
+	return r;
+}
 
-		//WriteXAsMultArg should similarly move mult tape head to cell after the blank
-		mult_idx += 2;
-		
-		//now write the initial result cell to the mult tape, move right, and transition
-		trace += traceStepExp("InitMultRes", mult_idx, exp_idx, tape, mult_tape);
-		writeSafe(mult_tape, '0', mult_idx);
-		mult_idx++;
-		
-		//write a blank (since the mult tape is reused, some unwanted bit characters could be here) and move left
-		trace += traceStepExp("MakeLastBlankInMult", mult_idx, exp_idx, tape, mult_tape);
-		writeSafe(mult_tape, 'B', mult_idx);
-		mult_idx--;
+/* run operation ("-add", "-mult" or "-exp") on x and y, or the machine described by machine if it isn't null, with
+ * its trace in a file whose name starts with name. Throws runtime_error if the trace can't be written or the
+ * machine goes wrong.
+ */
+RunResult runSimulation(const RunOptions &opt, const string &operation, const Machine *machine, const string &name,
+		const BigNum &x, const BigNum &y) {
+	RunResult r;
+	SimContext ctx;
+	ctx.accelerate = opt.accelerate;
+	ctx.cache = opt.cache;
+	ctx.trace_transitions = opt.detail.transitions;
+	ctx.trace_nested = opt.detail.nested;
+	ctx.analytic = opt.count;
+	string base = name + "_" + fileNamePart(x.toString()) + "_" + fileNamePart(y.toString());
+	//mult-fast and exp-fast keep their heads to themselves rather than in checkpoint frames
+	bool fast = operation == "-mult-fast" || operation == "-exp-fast";
+	if (fast && opt.engine != "native")
+		throw runtime_error(operation + " only runs on the native engine, not -engine=" + opt.engine);
+	if (opt.count && (opt.checkpoint_every > 0 || opt.resume))
+		throw runtime_error("-count can't be used with checkpoints");
+	//checked before the trace file is opened, so a run that can't go ahead leaves any trace of the same name alone
+	if ((opt.checkpoint_every > 0 || opt.resume) && (machine || fast))
+		throw runtime_error("Checkpoints can only be taken of the native add, mult and exp machines");
+	//a table machine is traced a step at a time, with no states of its own to leave out or nest
+	if (opt.trace && machine && (opt.detail.transitions || opt.detail.nested))
+		throw runtime_error("-trace-transitions and -trace-nested only apply to the native machines");
+	//windows would hide the tape a delta trace diffs against
+	if (opt.trace && opt.format == "delta" && opt.detail.window >= 0)
+		throw runtime_error("-trace-window only applies to text traces (and to -decode)");
+	if (opt.parallel_trace && opt.trace) {
+		if (machine || fast)
+			throw runtime_error("-parallel-trace only works with the native add, mult and exp machines");
+		if (opt.format != "text")
+			throw runtime_error("-parallel-trace only writes text traces");
+		if (opt.checkpoint_every > 0 || opt.resume)
+			throw runtime_error("-parallel-trace can't be used with checkpoints");
+		return runParallelTrace(opt, operation, base, x, y);
+	}
+	unique_ptr<FileTraceSink> sink;
+	unique_ptr<Tracer> trace;
+	//a text trace goes through an IndexTracer to the TextTracer in text_trace
+	unique_ptr<Tracer> text_trace;
+	unique_ptr<TraceIndex> index;
+	if (opt.trace) {
+		r.filename = base;
+		if (opt.format == "delta")
+			r.filename += ".tmd";
+		//the trace is written out while the simulation runs rather than after it
+		if (opt.resume) {
+			r.filename = opt.resume->trace_file;
+			ifstream old(r.filename.c_str(), ios::binary | ios::ate);
+			if (!old || (unsigned long long)old.tellg() < opt.resume->trace_offset)
+				throw runtime_error("Trace file \'" + r.filename + "\' is missing or shorter than the checkpoint expects");
+			sink.reset(new FileTraceSink(r.filename, opt.resume->trace_offset));
+		}
+		else
+			sink.reset(new FileTraceSink(r.filename));
+		if (!sink->isOpen())
+			throw runtime_error("Could not open trace file \'" + r.filename + "\'");
+		if (opt.format == "delta") {
+			//a delta trace is only as big as the changes
+			trace.reset(new DeltaTracer(*sink, opt.keyframe_every, opt.resume != nullptr, opt.detail.everyStep()));
+		}
+		else {
+			text_trace.reset(new TextTracer(*sink));
+			index.reset(new TraceIndex(r.filename + ".idx", *sink, ctx.steps));
+			trace.reset(new IndexTracer(*text_trace, index.get()));
+		}
+	}
+	else
+		trace.reset(new NullTracer());
+	vector<unique_ptr<Tracer> > detail_tracers;
+	Tracer &detailed = detailTracer(*trace, opt.detail, detail_tracers);
 
-		/* this state moves left for non-blank characters, and moves left and transitions for blanks,
-		 * to reach the rightmost cell of the second input on the mult tape
-		 */
-		trace += traceStepExp("MultMoveToYAfterInitResWrite", mult_idx, exp_idx, tape, mult_tape);
-		while (mult_idx > 0)
-			mult_idx = getNextY(mult_tape, mult_idx);
-		mult_idx = -mult_idx;
+	unique_ptr<Checkpointer> checkpoint;
+	string checkpoint_file = opt.checkpoint_file.empty() ? base + ".ckpt" : opt.checkpoint_file;
+	if (opt.checkpoint_every > 0 || opt.resume) {
+		Checkpoint settings;
+		settings.operation = operation;
+		settings.x = x.toString();
+		settings.y = y.toString();
+		settings.format = opt.format;
+		settings.keyframe_every = opt.keyframe_every;
+		settings.packed = opt.packed;
+		settings.mapped = opt.mapped ? MappedTape::directory : "";
+		settings.accelerate = opt.accelerate;
+		settings.detail = opt.detail;
+		settings.every = opt.checkpoint_every;
+		settings.trace_file = r.filename;
+		checkpoint.reset(new Checkpointer(checkpoint_file, settings, sink.get(), detailed));
+		if (opt.resume) {
+			istringstream saved(opt.resume->tracer);
+			DeltaReader in(saved, "checkpoint \'" + checkpoint_file + "\'");
+			detailed.loadState(in);
+			checkpoint->resumeFrom(*opt.resume);
+			ctx.steps = opt.resume->steps;
+		}
+		ctx.checkpoint = checkpoint.get();
+	}
+#ifdef TMSIM_PROFILE
+	Profiler profile;
+	ProfiledTracer profiled(detailed, profile);
+	Tracer &tracer = profiled;
+	ctx.profile = &profile;
+	chrono::steady_clock::time_point start = Profiler::now();
+#else
+	Tracer &tracer = detailed;
+#endif
 
-		//now go back to the last bit of the first input on the mult tape...
-		trace += traceStepExp("ToFirstInputEndInMultAfterXWrite", mult_idx, exp_idx, tape, mult_tape);
-		while (mult_idx > 0)
-			mult_idx = getNextY(mult_tape, mult_idx);
-		mult_idx = -mult_idx;
+	BigNum res;
+	if (machine) {
+		vector<char> tape;
+		if (opt.engine == "fixed" && operation == "-add")
+			tape = runFixed<FixedAdd>(*machine, x, y, tracer, ctx);
+		else if (opt.engine == "fixed" && operation == "-mult")
+			tape = runFixed<FixedMult>(*machine, x, y, tracer, ctx);
+		else if (opt.engine == "fixed" && operation == "-exp")
+			tape = runFixed<FixedExp>(*machine, x, y, tracer, ctx);
+		else if (opt.engine == "jit")
+			tape = runJit(*machine, x, y, tracer, ctx, opt.trace);
+		else
+			tape = runMachine(*machine, x, y, tracer, ctx);
+		res = interpretTapeRes(view(tape));
+	}
+	else
+		res = runNative(opt, operation, x, y, tracer, ctx);
 
-		//and finally go to the first bit of the first input to start the multiplication
-		trace += traceStepExp("ToFirstInputBeginInMultAfterArgWrites", mult_idx, exp_idx, tape, mult_tape);
-		while (mult_idx >= 0)
-			mult_idx = getNextX(mult_tape, mult_idx);
-		mult_idx = -mult_idx;
+	r.res = res.toString();
+	r.steps = ctx.steps;
+	tracer.text("\n\nInterpreted result of this computation: " + r.res);
+	if (sink)
+		sink->close();
+	if (index)
+		index->close();
+	//the machines from tables are simulated anyway, so there is nothing to check them against
+	if (opt.count_check && !machine) {
+		SimContext stepped;
+		stepped.accelerate = opt.accelerate;
+		NullTracer none;
+		string res = runNative(opt, operation, x, y, none, stepped).toString();
+		if (res != r.res || stepped.steps != r.steps)
+			throw runtime_error("-count came to " + r.res + " in " + to_string(r.steps) + " steps, but simulating every step came to "
+				+ res + " in " + to_string(stepped.steps));
+	}
+#ifdef TMSIM_PROFILE
+	//the report goes next to the trace
+	string report = (r.filename.empty() ? base : r.filename) + ".profile.json";
+	ofstream(report.c_str()) << profile.json("\t\"machine\": \"" + name + "\",\n\t\"x\": \"" + x.toString() + "\",\n\t\"y\": \""
+		+ y.toString() + "\",\n\t\"steps\": " + to_string(r.steps) + ",\n\t\"seconds\": "
+		+ to_string(chrono::duration<double>(Profiler::now() - start).count()) + ",\n");
+#endif
+	//a finished run has nothing left to resume
+	if (checkpoint)
+		remove(checkpoint_file.c_str());
+	return r;
+}
 
-		//Perform the multiplication (treat the entire process and all its state transitions as a black box in trace)
-		trace += traceStepExp("Mult*", mult_idx, exp_idx, tape, mult_tape);
-		mult_idx = multSim(add_tape, mult_tape, trace, false);
+//print where the trace of a run went and what it came to
+void printResult(const RunOptions &opt, const RunResult &r) {
+	if (opt.trace)
+		std::cout << "Created trace file \'" + r.filename + "\'\n";
+	std::cout << "Result: " + r.res + "\nSteps: " + to_string(r.steps) + "\n";
+	if (opt.count_check)
+		std::cout << "Simulating every step gave the same result and step count\n";
+	if (opt.cache)
+		std::cout << opt.cache->stats() + "\n";
+}
 
-		//Now to copy the product, need to move exp tape's head first from its current position, at the leftmost cell of y,
-		//to the leftmost result cell
-		trace += traceStepExp("ToExpResultForUpdate", mult_idx, exp_idx, tape, mult_tape);
-		while (exp_idx > 0)
-			exp_idx = addOneX(tape, exp_idx);
-		exp_idx = -exp_idx;
+//carry on a simulation from the checkpoint file an earlier run of it left behind
+int resume(const string &filename, ResultCache *cache) {
+	Checkpoint cp;
+	BigNum x, y;
+	try {
+		readCheckpoint(filename, cp);
+		if (!BigNum::parse(cp.x, x) || !BigNum::parse(cp.y, y) || (cp.operation != "-add" && cp.operation != "-mult" && cp.operation != "-exp"))
+			throw runtime_error("\'" + filename + "\' is not a checkpoint of add, mult or exp");
+		RunOptions opt;
+		opt.format = cp.format;
+		opt.keyframe_every = cp.keyframe_every;
+		opt.packed = cp.packed;
+		opt.mapped = !cp.mapped.empty();
+		if (opt.mapped)
+			MappedTape::directory = cp.mapped;
+		opt.accelerate = cp.accelerate;
+		opt.detail = cp.detail;
+		opt.trace = !cp.trace_file.empty();
+		opt.cache = cache;
+		opt.checkpoint_every = cp.every;
+		opt.checkpoint_file = filename;
+		opt.resume = &cp;
+		RunResult r = runSimulation(opt, cp.operation, nullptr, cp.operation.substr(1), x, y);
+		printResult(opt, r);
+	}
+	catch (const runtime_error &e) {
+		std::cerr << string(e.what()) + "\n";
+		return 1;
+	}
+	return 0;
+}
 
-		//Now that the tape heads are positioned correctly, write the product to the result cells on the exp tape
-		trace += traceStepExp("WriteProduct", mult_idx, exp_idx, tape, mult_tape);
-		copyUntilBlank(mult_tape, tape, mult_idx, exp_idx);
+//load the built-in machine descriptions and those in machine_file, if one is given
+void loadMachines(MachineLibrary &machines, const string &machine_file) {
+	istringstream builtin(BUILTIN_MACHINES);
+	machines.load(builtin, "built-in machines");
+	if (machine_file.empty())
+		return;
+	ifstream in(machine_file.c_str());
+	if (!in)
+		throw runtime_error("Could not open machine description \'" + machine_file + "\'");
+	machines.load(in, machine_file);
+}
 
-		/* All that's left is to move to the first cell of the first arg to start the next iteration in each tape
-		 * As in the multSim, this abbreviates 3 states within one (the combined result is going left until 3 blanks
-		 * have been seen, then positioning the tape head 1 position right of the 3rd blank
-		 */
-		trace += traceStepExp("FirstCellFromEndExpTape*", mult_idx, exp_idx, tape, mult_tape);
-		moveToMultStart(tape, exp_idx);
+//one line of a batch file
+struct BatchJob {
+	//"-add", "-mult" or "-exp" for a built-in machine, otherwise empty
+	string operation;
+	//the machine as it appears in trace file names
+	string name;
+	string str_x, str_y;
+	BigNum x, y;
+	RunResult result;
+	string error;
+	double seconds;
+};
 
-		trace += traceStepExp("FirstCellFromEndMultTape*", mult_idx, exp_idx, tape, mult_tape);
-		moveToMultStart(mult_tape, mult_idx);
+//quote a field of the summary if it has anything in it that CSV gives a meaning to
+string csvField(const string &field) {
+	if (field.find_first_of(",\"\n") == string::npos)
+		return field;
+	string res = "\"";
+	for (size_t i = 0; i < field.size(); i++) {
+		if (field[i] == '"')
+			res += '"';
+		res += field[i];
 	}
+	return res + "\"";
 }
 
-//simulate exponentiation x^y in a Turing machine for inputs x and y
-vector<char> exp(int x, int y, string &trace) {
-	vector<char> tape;
-	vector<char> mult_tape;
-	
-	//exp tape stores inputs x and y, and a result (which starts as 1)
-	initTape(x, y, tape);
-	tape.push_back('1');
-	tape.push_back('B');
-
-	//mult_tape is entirely blank initially
-	mult_tape.push_back('B');
+/* run every job in jobs_file, one "machine x y" per line where machine is add, mult, exp or a machine described in
+ * machine_file, on a pool of workers and write a line for each to the CSV file summary_file
+ */
+int runBatch(const RunOptions &opt, const string &jobs_file, const string &machine_file, string summary_file,
+		unsigned workers) {
+	ifstream in(jobs_file.c_str());
+	if (!in) {
+		std::cerr << "Could not open batch file \'" + jobs_file + "\'\n";
+		return 1;
+	}
+	MachineLibrary machines;
+	//each machine is built once and shared by all the jobs that run it
+	map<string, Machine> built;
+	bool table = opt.engine != "native" || !machine_file.empty();
+	vector<BatchJob> jobs;
+	try {
+		if (table)
+			loadMachines(machines, machine_file);
+		string line;
+		for (int line_no = 1; getline(in, line); line_no++) {
+			istringstream fields(line);
+			BatchJob job;
+			string extra;
+			if (!(fields >> job.name) || job.name[0] == '#')
+				continue;
+			string where = jobs_file + ":" + to_string(line_no) + ": ";
+			if (!(fields >> job.str_x >> job.str_y) || fields >> extra)
+				throw runtime_error(where + "expected a machine and two numbers");
+			if (job.name[0] == '-')
+				job.name = job.name.substr(1);
+			if (job.name == "add" || job.name == "mult" || job.name == "exp" || job.name == "mult-fast" || job.name == "exp-fast")
+				job.operation = "-" + job.name;
+			else if (!table)
+				throw runtime_error(where + "unknown machine \'" + job.name + "\'");
+			if (!BigNum::parse(job.str_x, job.x) || !BigNum::parse(job.str_y, job.y))
+				throw runtime_error(where + "not a decimal, 0x hex or 0b binary number");
+			//the fast machines have no descriptions, so they run natively or runSimulation() says they can't
+			bool fast = job.operation == "-mult-fast" || job.operation == "-exp-fast";
+			if (table && !fast && built.find(job.name) == built.end())
+				built[job.name] = machines.build(job.name);
+			jobs.push_back(job);
+		}
+	}
+	catch (const runtime_error &e) {
+		std::cerr << string(e.what()) + "\n";
+		return 1;
+	}
+	if (summary_file.empty()) {
+		size_t dot = jobs_file.rfind('.');
+		summary_file = (dot != string::npos && jobs_file.find('/', dot) == string::npos ? jobs_file.substr(0, dot) : jobs_file) + ".csv";
+	}
+	ofstream summary(summary_file.c_str());
+	if (!summary) {
+		std::cerr << "Could not open summary file \'" + summary_file + "\'\n";
+		return 1;
+	}
 
-	string str_x = to_string(x);
-	string str_y = to_string(y);
+	WorkStealingPool pool(workers);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	pool.run(jobs.size(), [&](size_t i) {
+		BatchJob &job = jobs[i];
+		chrono::steady_clock::time_point job_start = chrono::steady_clock::now();
+		try {
+			map<string, Machine>::const_iterator machine = built.find(job.name);
+			job.result = runSimulation(opt, job.operation, machine != built.end() ? &machine->second : nullptr, job.name, job.x, job.y);
+		}
+		catch (const runtime_error &e) {
+			job.error = e.what();
+		}
+		job.seconds = chrono::duration<double>(chrono::steady_clock::now() - job_start).count();
+	});
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
-	/* only mult tape and exp tape will appear in trace - all modifications and accesses to the add are lost
-	* in the abbreviated trace format since they're now less "interesting"
-	*/
-	trace = "Abbreviated Trace for " + str_x + " ^ " + str_y + " (x to the yth power)\n\n";
-	trace += "State: Start\nCurrent Mult Index: 0\nCurrent Exp Index: 0\nInitial Mult Tape: " + (string(mult_tape.begin(), mult_tape.end())) + "\nInitial Exp Tape: " + (string(tape.begin(), tape.end())) + "\n\n";
-	
-	expSim(mult_tape, tape, trace);
-	return tape;
+	int failed = 0;
+	summary << "machine,x,y,result,steps,seconds,trace,error\n";
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const BatchJob &job = jobs[i];
+		failed += !job.error.empty();
+		summary << job.name << ',' << csvField(job.str_x) << ',' << csvField(job.str_y) << ',' << job.result.res << ','
+			<< (job.error.empty() ? to_string(job.result.steps) : "") << ',' << job.seconds << ','
+			<< csvField(job.result.filename) << ',' << csvField(job.error) << '\n';
+	}
+	summary.close();
+	std::cout << "Ran " + to_string(jobs.size()) + " jobs on " + to_string(pool.size()) + " workers in "
+		+ to_string(seconds) + "s\nCreated summary file \'" + summary_file + "\'\n";
+	if (opt.cache)
+		std::cout << opt.cache->stats() + "\n";
+	if (failed > 0) {
+		std::cerr << to_string(failed) + " jobs failed, see the error column of the summary\n";
+		return 1;
+	}
+	return 0;
 }
 
+//bench.cpp includes this file for the simulation and has its own main
+#ifndef TMSIM_NO_MAIN
 int main(int argc, char *argv[])
 {   
-	if (argc != 4)
-		return 0;
-	string trace;
-	ofstream outfile;
-	int x = atoi(argv[2]);
-	int y = atoi(argv[3]);
-	string operation = argv[1];
-	string res;
-	string filename;
-	vector<char> tape;
-	string str_x = to_string(x);
-	string str_y = to_string(y);
-
-	if (operation == "-add") {
-		tape = add(x, y, trace);
-		filename = "add_" + str_x + "_" + str_y;
+	RunOptions opt;
+	string machine_file;
+	string batch_file;
+	string summary_file;
+	unsigned workers = thread::hardware_concurrency();
+	unique_ptr<ResultCache> cache;
+	bool parallel_trace = false;
+	vector<string> args;
+	string value;
+	unsigned long long number;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (optionValue(arg, "-trace-format", value))
+			opt.format = value;
+		else if (optionValue(arg, "-keyframe-every", value)) {
+			if (!countOption("-keyframe-every", value, 1, UINT_MAX, number))
+				return 1;
+			opt.keyframe_every = number;
+		}
+		else if (arg == "-packed")
+			opt.packed = true;
+		else if (arg == "-mapped")
+			opt.mapped = true;
+		else if (optionValue(arg, "-mapped", value)) {
+			opt.mapped = true;
+			MappedTape::directory = value;
+		}
+		else if (optionValue(arg, "-engine", value))
+			opt.engine = value;
+		else if (optionValue(arg, "-machine", value))
+			machine_file = value;
+		else if (arg == "-no-accel")
+			opt.accelerate = false;
+		else if (arg == "-no-trace")
+			opt.trace = false;
+		else if (optionValue(arg, "-summary", value))
+			summary_file = value;
+		else if (optionValue(arg, "-workers", value)) {
+			if (!countOption("-workers", value, 1, UINT_MAX, number))
+				return 1;
+			workers = number;
+		}
+		//a cache of 0 MB would never keep anything
+		else if (optionValue(arg, "-cache", value)) {
+			if (!countOption("-cache", value, 1, SIZE_MAX >> 20, number))
+				return 1;
+			cache.reset(new ResultCache((size_t)number << 20));
+		}
+		else if (optionValue(arg, "-checkpoint-every", value)) {
+			char *end;
+			opt.checkpoint_every = strtod(value.c_str(), &end);
+			if (value.empty() || *end || !(opt.checkpoint_every > 0 && std::isfinite(opt.checkpoint_every))) {
+				std::cerr << "-checkpoint-every takes a number of seconds above 0, not \'" + value + "\'\n";
+				return 1;
+			}
+		}
+		else if (optionValue(arg, "-trace-window", value)) {
+			if (!countOption("-trace-window", value, 0, LLONG_MAX, number))
+				return 1;
+			opt.detail.window = number;
+		}
+		else if (optionValue(arg, "-trace-every", value)) {
+			if (!countOption("-trace-every", value, 1, ULLONG_MAX, opt.detail.every))
+				return 1;
+		}
+		else if (arg == "-trace-transitions")
+			opt.detail.transitions = true;
+		else if (arg == "-trace-nested")
+			opt.detail.nested = true;
+		else if (arg == "-parallel-trace")
+			parallel_trace = true;
+		else if (optionValue(arg, "-parallel-trace", value)) {
+			parallel_trace = true;
+			if (!countOption("-parallel-trace", value, 1, ULLONG_MAX, opt.parallel_every))
+				return 1;
+		}
+		//a count has nothing to trace
+		else if (arg == "-count" || arg == "-count=check") {
+			opt.count = true;
+			opt.count_check = arg == "-count=check";
+			opt.trace = false;
+		}
+		else
+			args.push_back(arg);
 	}
-	else if (operation == "-mult") {
-		tape = mult(x, y, trace);
-		filename = "mult_" + str_x + "_" + str_y;
+	if (parallel_trace)
+		opt.parallel_trace = max(workers, 1u);
+	if (args.size() >= 2 && args.size() <= 3 && args[0] == "-decode")
+		return decode(args[1], args.size() == 3 ? args[2] : "", opt.detail);
+	if (args.size() == 2 && args[0] == "-resume")
+		return resume(args[1], cache.get());
+	if ((args.size() >= 3 && args.size() <= 4 && args[0] == "-replay") || (args.size() == 3 && args[0] == "-replay-tape")) {
+		unsigned long long step, records = 1;
+		if (!parseCount(args[2], step)) {
+			std::cerr << "'" + args[2] + "' is not a step number\n";
+			return 1;
+		}
+		if (args.size() == 4 && (!parseCount(args[3], records) || records == 0)) {
+			std::cerr << "'" + args[3] + "' is not a number of records above 0\n";
+			return 1;
+		}
+		return args[0] == "-replay" ? replay(args[1], step, records) : replayTape(args[1], step);
 	}
-	else if (operation == "-exp") {
-		tape = exp(x, y, trace);
-		filename = "exp_" + str_x + "_" + str_y;
+	if (args.size() == 2 && args[0] == "-batch")
+		batch_file = args[1];
+	if (opt.format != "text" && opt.format != "delta") {
+		std::cerr << "Unknown trace format '" + opt.format + "' (text or delta)\n";
+		return 1;
 	}
-	else
+	if (opt.engine != "native" && opt.engine != "table" && opt.engine != "fixed" && opt.engine != "jit") {
+		std::cerr << "Unknown engine '" + opt.engine + "' (native, table, fixed or jit)\n";
+		return 1;
+	}
+	opt.cache = cache.get();
+	if (!batch_file.empty())
+		return runBatch(opt, batch_file, machine_file, summary_file, workers);
+	//a machine from a file takes just the two inputs
+	size_t first_num = machine_file.empty() ? 1 : 0;
+	if (args.size() != first_num + 2)
 		return 0;
-	
-	outfile.open(filename);
-	res = to_string(interpretTapeRes(tape));
-	outfile << trace + "\n\nInterpreted result of this computation: " + res;
-	std::cout << "Created trace file \'" + filename + "\'\nResult: " + res + "\n";
+	BigNum x, y;
+	for (size_t i = first_num; i < args.size(); i++) {
+		if (!BigNum::parse(args[i], i == first_num ? x : y)) {
+			std::cerr << "\'" + args[i] + "\' is not a decimal, 0x hex or 0b binary number\n";
+			return 1;
+		}
+	}
+	string operation = machine_file.empty() ? args[0] : "";
+	string name;
+	if (operation == "-add" || operation == "-mult" || operation == "-exp" || operation == "-mult-fast" || operation == "-exp-fast")
+		name = operation.substr(1);
+	else if (machine_file.empty())
+		return 0;
+
+	MachineLibrary machines;
+	Machine machine;
+	//compiled in machines still take their tapes and tracing from the descriptions, which the fast machines don't have
+	bool fast = operation == "-mult-fast" || operation == "-exp-fast";
+	bool table = (opt.engine != "native" && !fast) || !machine_file.empty();
+	try {
+		if (table) {
+			loadMachines(machines, machine_file);
+			if (!machine_file.empty())
+				name = machines.lastName();
+			machine = machines.build(name);
+		}
+		RunResult r = runSimulation(opt, operation, table ? &machine : nullptr, name, x, y);
+		printResult(opt, r);
+	}
+	catch (const runtime_error &e) {
+		std::cerr << string(e.what()) + "\n";
+		return 1;
+	}
 	return 0;
 }
-
+#endif